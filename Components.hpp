@@ -19,27 +19,33 @@ public:
 	Vec2f pos		{ 0.0f, 0.0f };
 	Vec2f velocity	{ 0.0f, 0.0f };
 	float angle		{ 0.0f };
+	Vec2f prevPos	{ 0.0f, 0.0f };	// pos and angle before the last tick, the renderer interpolates from these
+	float prevAngle	{ 0.0f };
 
 	CTransform() = default;
 	CTransform(const Vec2f& p, const Vec2f& v, float a)
-		: pos(p), velocity(v), angle(a) {}
+		: pos(p), velocity(v), angle(a), prevPos(p), prevAngle(a) {}
 };
 
 
 // Circle Shape Component
+// Only describes the shape, the renderer builds the geometry from it every frame, so the
+// component holds no vertices or transform of its own and costs nothing on the heap
 class CShape : public Component
 {
 public:
-	sf::CircleShape circle;
+	float		radius{ 0.0f };
+	float		thickness{ 0.0f };		// outline, grows outwards from the edge
+	uint32_t	fill{ 0xFFFFFFFF };		// RGBA, see sf::Color::toInteger
+	uint32_t	outline{ 0xFFFFFFFF };
+	uint16_t	points{ 0 };
+
 	CShape() = default;
-	CShape(float radius, size_t points, const sf::Color& fill, const sf::Color& outline, float thickness)
-		: circle(radius, points)
-	{
-		circle.setFillColor(fill);
-		circle.setOutlineColor(outline);
-		circle.setOutlineThickness(thickness);
-		circle.setOrigin({ radius, radius });
-	}
+	CShape(float r, size_t p, const sf::Color& f, const sf::Color& o, float t)
+		: radius(r), thickness(t), fill(f.toInteger()), outline(o.toInteger()), points(static_cast<uint16_t>(p)) {}
+
+	sf::Color fillColor() const { return sf::Color(fill); }
+	sf::Color outlineColor() const { return sf::Color(outline); }
 };
 
 // Collision Component
@@ -69,11 +75,11 @@ public:
 class CLifespan : public Component
 {
 public:
-	int lifespan{ 0 };
-	int remaining{ 0 };
+	int lifespan{ 0 };	// in ticks
+	int expires{ 0 };	// lifespan tick the entity is destroyed on (see Game::sLifespan), the renderer fades it out until then
 	CLifespan() = default;
-	CLifespan(int totalLifespan)
-		: lifespan(totalLifespan), remaining(totalLifespan){}
+	CLifespan(int totalLifespan, int currentFrame)
+		: lifespan(totalLifespan), expires(currentFrame + totalLifespan){}
 };
 
 // Input Component
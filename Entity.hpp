@@ -3,10 +3,15 @@
 
 #include <tuple>
 #include <string>
+#include <cstdint>
+#include <type_traits>
 #include "Components.hpp"
 
 class EntityManager;
 
+// Tags are registered once with EntityManager::registerTag and referred to by this small id
+using TagId = uint16_t;
+
 using ComponentTuple = std::tuple<
 	CTransform,
 	CShape,
@@ -16,74 +21,98 @@ using ComponentTuple = std::tuple<
 	CLifespan
 >;
 
+// Components in ComponentTuple have a place in every entity slot. Any other component type is
+// kept in a sparse set of its own (see SparseSet), the same Entity calls work for both
+template <typename T, typename Tuple>
+struct InTuple;
+
+template <typename T, typename... Ts>
+struct InTuple<T, std::tuple<Ts...>> : std::bool_constant<(std::is_same_v<T, Ts> || ...)> {};
+
+template <typename T>
+constexpr bool isPooled = InTuple<T, ComponentTuple>::value;
+
+// Which components an entity has, one bit per type in ComponentTuple order
+using Signature = uint32_t;
+
+template <typename T, typename Tuple>
+struct ComponentIndex;
+
+template <typename T, typename... Ts>
+struct ComponentIndex<T, std::tuple<T, Ts...>> { static constexpr size_t value = 0; };
+
+template <typename T, typename U, typename... Ts>
+struct ComponentIndex<T, std::tuple<U, Ts...>> { static constexpr size_t value = 1 + ComponentIndex<T, std::tuple<Ts...>>::value; };
+
+template <typename... Ts>
+constexpr Signature signatureOf()
+{
+	return ((Signature(1) << ComponentIndex<Ts, ComponentTuple>::value) | ... | 0);
+}
+
+// Handle to an entity stored in an EntityManager.
+// The components live in the manager's slots, the handle only holds the slot index and the
+// generation of that slot when the entity was created. Once the slot is recycled for a new
+// entity its generation changes, so old handles are detected as stale instead of aliasing it.
 class Entity		
 {
 	friend class EntityManager;
 
-	ComponentTuple	m_components;
-	bool			m_active = true;
-	std::string		m_tag = "default";
-	size_t			m_id = 0;
+	EntityManager*	m_manager = nullptr;
+	uint32_t		m_index = 0;
+	uint32_t		m_generation = 0;
 
-	Entity (const size_t& id, const std::string& tag)
-		: m_tag(tag)
-		, m_id(id)
+	Entity (EntityManager* manager, uint32_t index, uint32_t generation)
+		: m_manager(manager)
+		, m_index(index)
+		, m_generation(generation)
 	{}
 
 
 public:
-	bool isActive() const
-	{
-		return m_active;
-	}
+	Entity() = default;
 
-	void destroy()
-	{
-		m_active = false;
-	}
+	// False once the entity's slot has been recycled, or for a default constructed handle
+	bool isValid() const;
 
-	size_t id() const
-	{
-		return m_id;
-	}
+	bool isActive() const;
+
+	void destroy() const;
+
+	size_t id() const;
+
+	TagId tag() const;
 
-	const std::string& tag() const
+	const std::string& tagName() const;
+
+	uint32_t index() const
 	{
-		return m_tag;
+		return m_index;
 	}
 
-	template <typename T>
-	bool has() const
+	uint32_t generation() const
 	{
-		return get<T>().exists;
+		return m_generation;
 	}
 
-	template <typename T, typename... TArgs>
-	T& add(TArgs&&... mArgs)
+	bool operator == (const Entity& rhs) const
 	{
-		auto& component = get<T>();
-		component = T(std::forward<TArgs>(mArgs)...);
-		component.exists = true;
-		return component;
+		return m_manager == rhs.m_manager && m_index == rhs.m_index && m_generation == rhs.m_generation;
 	}
 
 	template <typename T>
-	T& get() 
-	{
-		return std::get<T>(m_components);
-	}
+	bool has() const;
+
+	// Adding or removing a pooled component moves the entity to another archetype on the next
+	// EntityManager::update, see EntityManager::view. Sparse components aren't part of archetypes
+	template <typename T, typename... TArgs>
+	T& add(TArgs&&... mArgs) const;
 
 	template <typename T>
-	const T& get() const
-	{
-		return std::get<T>(m_components);
-	}
+	T& get() const;
 
 	template <typename T>
-	void remove()
-	{
-		get<T>() = T();
-	}
+	void remove() const;
 
 };
 
@@ -2,70 +2,376 @@
 #define ENTITYMANAGER_HPP
 
 #include "Entity.hpp"
-#include <map>
+#include "SparseSet.hpp"
+#include <vector>
+#include <cassert>
+#include <algorithm>
 
-using EntityVec = std::vector<std::shared_ptr<Entity>>;
+using EntityVec = std::vector<Entity>;
+
+// One std::vector per component type, all indexed by entity slot
+template <typename Tuple>
+struct ComponentPools;
+
+template <typename... Ts>
+struct ComponentPools<std::tuple<Ts...>>
+{
+	using type = std::tuple<std::vector<Ts>...>;
+};
+
+// Occupancy of the entity slot pool
+struct PoolStats
+{
+	size_t capacity{ 0 };		// slots allocated
+	size_t live{ 0 };			// slots holding an entity
+	size_t highWater{ 0 };		// most slots ever live at once
+	size_t recycled{ 0 };		// entities placed in a slot a previous entity had used
+	size_t growths{ 0 };		// times the pool had to be enlarged
+};
+
+// Entities with the same tag and the same components. Only the handles are grouped, the
+// components stay in the shared per-type pools: what an archetype buys is skipping entities
+// without the wanted components, and a list sorted by slot so the pools are read in
+// increasing order. Together with the per-tag slot chunks (see acquireSlot) that keeps
+// a walk mostly within a few stretches of each pool, it doesn't make them contiguous
+struct Archetype
+{
+	TagId		tag{ 0 };
+	Signature	signature{ 0 };
+	EntityVec	entities;
+	EntityVec	joining;		// placed here by the next update
+	bool		dirty{ false };	// some of entities left or died
+
+	Archetype(TagId t, Signature s)
+		: tag(t), signature(s) {}
+};
+
+template <typename... Ts>
+class View;
 
 class EntityManager
 {
+	friend class Entity;
+	template <typename... Ts>
+	friend class View;
+
+	static constexpr uint16_t NO_ARCHETYPE = 0xFFFF;
+	static constexpr size_t CHUNK = 256;	// slots given to a tag at a time, see acquireSlot
+
 	EntityVec							m_entities;
 	EntityVec							m_entitiesToAdd;
-	std::map<std::string, EntityVec>	m_entityMap;
+	std::vector<EntityVec>				m_entitiesByTag;	// indexed by TagId
+	std::vector<std::string>			m_tagNames;			// indexed by TagId
 	size_t								m_totalEntities{ 0 };
+	bool								m_stableOrder{ true };	// keep insertion order when removing
 
-	void removeDeadEntites(EntityVec& Vec)
+	// Slot map storage, every vector below is indexed by Entity::m_index
+	ComponentPools<ComponentTuple>::type	m_components;
+	std::vector<uint32_t>					m_generations;
+	std::vector<uint8_t>					m_active;		// not vector<bool>, systems running on several threads destroy neighbouring slots
+	std::vector<size_t>						m_ids;
+	std::vector<TagId>						m_tags;
+	std::vector<std::vector<uint32_t>>		m_freeSlots;	// per TagId, LIFO so the most recently freed slot is reused first
+	size_t									m_chunks{ 0 };	// handed out so far, the slots after them are unused
+	std::vector<Signature>					m_signatures;	// components each slot has now
+	std::vector<uint16_t>					m_archetypeOf;	// archetype each slot is listed in
+	std::vector<Archetype>					m_archetypes;
+	EntityVec								m_changed;		// entities that need to be (re)placed in an archetype
+	EntityVec								m_viewAdded;	// scratch list for View::chunks, kept to reuse its memory
+	std::vector<std::unique_ptr<SparseSetBase>>	m_sparse;	// components outside ComponentTuple, indexed by sparseTypeId
+	PoolStats								m_poolStats;
+
+	// Removes inactive entities in a single linear pass
+	void removeDeadEntites(EntityVec& vec)
 	{
-		for (auto it = Vec.begin(); it != Vec.end();)
+		if (m_stableOrder)
+		{
+			// Compact in place, survivors keep their relative order
+			std::erase_if(vec, [](const Entity& e) { return !e.isActive(); });
+		}
+		else
 		{
-			// If no longer active, delete
-			if ( !((*it)->isActive()) )
+			// Swap-and-pop: fill each hole with the last entity, order is not kept
+			for (size_t i = 0; i < vec.size();)
 			{
-				it = Vec.erase(it);
+				if (!vec[i].isActive())
+				{
+					vec[i] = vec.back();
+					vec.pop_back();
+				}
+				else
+					++i;
+			}
+		}
+	}
+
+	// Clears a dead entity's components and makes its slot available again.
+	// Bumping the generation invalidates every handle still pointing at the slot.
+	void releaseSlot(uint32_t index)
+	{
+		std::apply([index](auto&... pools) { ((pools[index] = {}), ...); }, m_components);
+		for (auto& store : m_sparse)
+		{
+			if (store)
+				store->remove(index);
+		}
+		if (m_archetypeOf[index] != NO_ARCHETYPE)
+			m_archetypes[m_archetypeOf[index]].dirty = true;
+		m_signatures[index] = 0;
+		m_archetypeOf[index] = NO_ARCHETYPE;
+		m_generations[index]++;
+		m_freeSlots[m_tags[index]].push_back(index);
+		m_poolStats.live--;
+	}
+
+	// Slots are handed to tags a chunk at a time, so the entities of one tag sit together in
+	// every component pool and a walk over them reads whole cache lines of their components
+	uint32_t acquireSlot(TagId tag)
+	{
+		auto& free = m_freeSlots[tag];
+		if (free.empty())
+		{
+			// Out of slots, double the pool in one go rather than growing it per entity
+			size_t begin = m_chunks * CHUNK;
+			if (begin + CHUNK > m_generations.size())
+			{
+				grow(std::max(begin + CHUNK, 2 * m_generations.size()));
+				m_poolStats.growths++;
+			}
+			m_chunks++;
+
+			// Pushed in reverse so the lowest index is handed out first
+			for (size_t i = begin + CHUNK; i-- > begin;)
+				free.push_back(static_cast<uint32_t>(i));
+		}
+
+		uint32_t index = free.back();
+		free.pop_back();
+
+		if (m_generations[index] > 0)
+			m_poolStats.recycled++;
+		m_poolStats.live++;
+		m_poolStats.highWater = std::max(m_poolStats.highWater, m_poolStats.live);
+
+		return index;
+	}
+
+	// Allocates slots up to the given capacity, acquireSlot gives them out
+	void grow(size_t capacity)
+	{
+		size_t old = m_generations.size();
+		if (capacity <= old)
+			return;
+
+		std::apply([capacity](auto&... pools) { (pools.resize(capacity), ...); }, m_components);
+		m_generations.resize(capacity, 0);
+		m_active.resize(capacity, false);
+		m_ids.resize(capacity, 0);
+		m_tags.resize(capacity, 0);
+		m_signatures.resize(capacity, 0);
+		m_archetypeOf.resize(capacity, NO_ARCHETYPE);
+
+		m_poolStats.capacity = capacity;
+	}
+
+	uint16_t findArchetype(TagId tag, Signature signature)
+	{
+		for (size_t i = 0; i < m_archetypes.size(); ++i)
+		{
+			if (m_archetypes[i].tag == tag && m_archetypes[i].signature == signature)
+				return static_cast<uint16_t>(i);
+		}
+
+		m_archetypes.emplace_back(tag, signature);
+		return static_cast<uint16_t>(m_archetypes.size() - 1);
+	}
+
+	// Moves new entities and ones whose components changed into their archetype, and drops
+	// the dead. Only the archetypes that changed are touched, newcomers are sorted on their
+	// own and merged in so the lists stay sorted by slot
+	void updateArchetypes()
+	{
+		for (auto& e : m_changed)
+		{
+			if (!e.isActive())
+				continue;
+
+			uint16_t archetype = findArchetype(m_tags[e.m_index], m_signatures[e.m_index]);
+			uint16_t& current = m_archetypeOf[e.m_index];
+			if (current == archetype)
+				continue;
+
+			if (current != NO_ARCHETYPE)
+				m_archetypes[current].dirty = true;
+			current = archetype;
+			m_archetypes[archetype].joining.push_back(e);
+		}
+		m_changed.clear();
+
+		auto bySlot = [](const Entity& a, const Entity& b) { return a.m_index < b.m_index; };
+		for (uint16_t a = 0; a < m_archetypes.size(); ++a)
+		{
+			Archetype& archetype = m_archetypes[a];
+			if (archetype.dirty)
+			{
+				std::erase_if(archetype.entities, [&](const Entity& e) { return !e.isActive() || m_archetypeOf[e.m_index] != a; });
+				archetype.dirty = false;
+			}
+
+			if (!archetype.joining.empty())
+			{
+				size_t kept = archetype.entities.size();
+				std::sort(archetype.joining.begin(), archetype.joining.end(), bySlot);
+				archetype.entities.insert(archetype.entities.end(), archetype.joining.begin(), archetype.joining.end());
+				std::inplace_merge(archetype.entities.begin(), archetype.entities.begin() + kept, archetype.entities.end(), bySlot);
+				archetype.joining.clear();
 			}
-			else
-				++it;
 		}
 	}
 
 public:
 	EntityManager() = default;
 
+	// Handles point back at the manager, so it must stay where it is
+	EntityManager(const EntityManager&) = delete;
+	EntityManager& operator=(const EntityManager&) = delete;
+
 	void update()
 	{
 		//	add entities from m_entitiesToAdd to proper locatoins
+		m_entities.insert(m_entities.end(), m_entitiesToAdd.begin(), m_entitiesToAdd.end());
+		m_changed.insert(m_changed.end(), m_entitiesToAdd.begin(), m_entitiesToAdd.end());
+		m_entitiesToAdd.clear();
 
-		for (auto it = m_entitiesToAdd.begin(); it != m_entitiesToAdd.end();)
+		// free the slots of dead entities, every entity is in m_entities exactly once
+		for (auto& e : m_entities)
 		{
-			m_entities.push_back(*it);
-			it = m_entitiesToAdd.erase(it);
+			if (!e.isActive())
+				releaseSlot(e.m_index);
 		}
 
 		// remove dead entities from vector of all entities
 		removeDeadEntites(m_entities);
 
-		// C++20 way of iterating through [key, value] pairs in a map
-		for (auto& [tag, entityVec] : m_entityMap)
+		for (auto& entityVec : m_entitiesByTag)
 		{
 			removeDeadEntites(entityVec);
 		}
 
+		updateArchetypes();
+
 	} // End of update function
 
-	std::shared_ptr<Entity> addEntity(const std::string& tag)
+	// Allocates enough slots for this many live entities, so the component
+	// storage doesn't have to be reallocated and moved while the game runs
+	void reserve(size_t capacity)
 	{
-		// Create entity shared pointer
-		auto entity = std::shared_ptr<Entity>(new Entity(m_totalEntities++, tag));
+		grow(capacity);
+	}
 
-		//Add it to vec of entities to be added
-		m_entitiesToAdd.push_back(entity);
+	// Component storage for one type, indexed by Entity::index(). For systems that walk many
+	// entities and want to skip the per-handle lookup; only valid until the pool grows.
+	template <typename T>
+	T* components()
+	{
+		return std::get<std::vector<T>>(m_components).data();
+	}
+
+	// Store for a component type that isn't in ComponentTuple, created the first time it is
+	// asked for. Indexed by Entity::index(), Entity::add / get / has / remove use it for such types
+	template <typename T>
+	SparseSet<T>& sparse()
+	{
+		static_assert(!isPooled<T>, "T is in ComponentTuple, use components<T>");
+		size_t id = sparseTypeId<T>();
+		if (id >= m_sparse.size())
+			m_sparse.resize(id + 1);
+		if (!m_sparse[id])
+			m_sparse[id] = std::make_unique<SparseSet<T>>();
+		return static_cast<SparseSet<T>&>(*m_sparse[id]);
+	}
+
+	// Memory held by all the sparse stores
+	size_t sparseBytes() const
+	{
+		size_t bytes = m_sparse.capacity() * sizeof(m_sparse[0]);
+		for (auto& store : m_sparse)
+			bytes += store ? store->bytes() : 0;
+		return bytes;
+	}
+
+	// Every entity with all of Ts, grouped by archetype. Like getEntities it reflects the last update
+	template <typename... Ts>
+	View<Ts...> view();
+
+	// The same, only entities with this tag
+	template <typename... Ts>
+	View<Ts...> view(TagId tag);
+
+	size_t archetypeCount() const
+	{
+		return m_archetypes.size();
+	}
+
+	const PoolStats& poolStats() const
+	{
+		return m_poolStats;
+	}
+
+	// Stable order (the default) keeps every entity list in insertion order, which keeps
+	// iteration order and therefore replays deterministic. Unstable order removes dead entities
+	// with swap-and-pop, which moves fewer elements when only a few entities die.
+	void setStableOrder(bool stable)
+	{
+		m_stableOrder = stable;
+	}
+
+	bool stableOrder() const
+	{
+		return m_stableOrder;
+	}
 
-		//Add to entity map
-		if (m_entityMap.find(tag) == m_entityMap.end())
+	// Returns the id for a tag name, registering it the first time it is seen.
+	// Meant to be called once per tag at startup, the id is then used everywhere else.
+	TagId registerTag(const std::string& name)
+	{
+		for (size_t i = 0; i < m_tagNames.size(); ++i)
 		{
-			m_entityMap[tag] = EntityVec();
+			if (m_tagNames[i] == name)
+				return static_cast<TagId>(i);
 		}
 
-		m_entityMap[tag].push_back(entity);
+		m_tagNames.push_back(name);
+		m_entitiesByTag.emplace_back();
+		m_freeSlots.emplace_back();
+		return static_cast<TagId>(m_tagNames.size() - 1);
+	}
+
+	const std::string& tagName(TagId tag) const
+	{
+		return m_tagNames[tag];
+	}
+
+	size_t tagCount() const
+	{
+		return m_tagNames.size();
+	}
+
+	Entity addEntity(TagId tag)
+	{
+		// Take a free slot and hand out a handle to it
+		uint32_t index = acquireSlot(tag);
+		m_active[index] = true;
+		m_ids[index] = m_totalEntities++;
+		m_tags[index] = tag;
+
+		Entity entity(this, index, m_generations[index]);
+
+		//Add it to vec of entities to be added
+		m_entitiesToAdd.push_back(entity);
+
+		//Add to its tag's list
+		m_entitiesByTag[tag].push_back(entity);
 
 		return entity;
 	}
@@ -75,19 +381,199 @@ public:
 		return m_entities;
 	}
 
+	const EntityVec& getEntities(TagId tag)
+	{
+		return m_entitiesByTag[tag];
+	}
+
+	// String convenience versions, these look the tag up by name on every call
+	Entity addEntity(const std::string& tag)
+	{
+		return addEntity(registerTag(tag));
+	}
+
 	const EntityVec& getEntities(const std::string& tag)
 	{
-		if (m_entityMap.find(tag) == m_entityMap.end())
-			m_entityMap[tag] = EntityVec();
+		return getEntities(registerTag(tag));
+	}
+
+};
+
+// Entity members that need the complete EntityManager
+
+inline bool Entity::isValid() const
+{
+	return m_manager && m_index < m_manager->m_generations.size() && m_manager->m_generations[m_index] == m_generation;
+}
+
+inline bool Entity::isActive() const
+{
+	return isValid() && m_manager->m_active[m_index];
+}
+
+inline void Entity::destroy() const
+{
+	if (isValid())
+		m_manager->m_active[m_index] = false;
+}
 
-		return m_entityMap[tag];
+inline size_t Entity::id() const
+{
+	assert(isValid());
+	return m_manager->m_ids[m_index];
+}
+
+inline TagId Entity::tag() const
+{
+	assert(isValid());
+	return m_manager->m_tags[m_index];
+}
+
+inline const std::string& Entity::tagName() const
+{
+	return m_manager->tagName(tag());
+}
+
+template <typename T>
+bool Entity::has() const
+{
+	if constexpr (isPooled<T>)
+		return get<T>().exists;
+	else
+		return isValid() && m_manager->sparse<T>().has(m_index);
+}
+
+template <typename T>
+T& Entity::get() const
+{
+	assert(isValid());
+	if constexpr (isPooled<T>)
+		return std::get<std::vector<T>>(m_manager->m_components)[m_index];
+	else
+		return m_manager->sparse<T>().get(m_index);
+}
+
+template <typename T, typename... TArgs>
+T& Entity::add(TArgs&&... mArgs) const
+{
+	if constexpr (isPooled<T>)
+	{
+		auto& component = get<T>();
+		component = T(std::forward<TArgs>(mArgs)...);
+		component.exists = true;
+
+		Signature& signature = m_manager->m_signatures[m_index];
+		if (!(signature & signatureOf<T>()) && m_manager->m_archetypeOf[m_index] != EntityManager::NO_ARCHETYPE)
+			m_manager->m_changed.push_back(*this);
+		signature |= signatureOf<T>();
+		return component;
+	}
+	else
+	{
+		assert(isValid());
+		T& component = m_manager->sparse<T>().add(m_index, T(std::forward<TArgs>(mArgs)...));
+		component.exists = true;
+		return component;
+	}
+}
+
+template <typename T>
+void Entity::remove() const
+{
+	if constexpr (isPooled<T>)
+	{
+		get<T>() = T();
+
+		Signature& signature = m_manager->m_signatures[m_index];
+		if ((signature & signatureOf<T>()) && m_manager->m_archetypeOf[m_index] != EntityManager::NO_ARCHETYPE)
+			m_manager->m_changed.push_back(*this);
+		signature &= ~signatureOf<T>();
+	}
+	else if (isValid())
+	{
+		m_manager->sparse<T>().remove(m_index);
+	}
+}
+
+// The entities of every archetype that has all of Ts. Systems either take the lists one at
+// a time (chunks, e.g. to split them over the job system) or let each hand them the components
+template <typename... Ts>
+class View
+{
+	EntityManager&		m_manager;
+	Signature			m_signature;
+	TagId				m_tag;
+	bool				m_anyTag;
+
+public:
+	View(EntityManager& manager, TagId tag, bool anyTag)
+		: m_manager(manager), m_signature(signatureOf<Ts...>()), m_tag(tag), m_anyTag(anyTag) {}
+
+	bool matches(const Archetype& archetype) const
+	{
+		return (archetype.signature & m_signature) == m_signature && (m_anyTag || archetype.tag == m_tag);
+	}
+
+	// Calls f(entities) for every matching archetype, the list is sorted by slot.
+	// Entities added since the last update come last, in a list of their own
+	template <typename F>
+	void chunks(F&& f) const
+	{
+		for (auto& archetype : m_manager.m_archetypes)
+		{
+			if (matches(archetype) && !archetype.entities.empty())
+				f(archetype.entities);
+		}
+
+		if (m_manager.m_entitiesToAdd.empty())
+			return;
+
+		// Borrowed from the manager, so a view used every frame doesn't allocate. A nested
+		// view finds it taken and makes its own
+		EntityVec added;
+		added.swap(m_manager.m_viewAdded);
+		added.clear();
+		for (const Entity& e : m_manager.m_entitiesToAdd)
+		{
+			Signature signature = m_manager.m_signatures[e.index()];
+			if (e.isActive() && (signature & m_signature) == m_signature && (m_anyTag || m_manager.m_tags[e.index()] == m_tag))
+				added.push_back(e);
+		}
+		if (!added.empty())
+			f(added);
+		added.swap(m_manager.m_viewAdded);
 	}
 
-	const std::map<std::string, EntityVec>& getEntityMap()
+	// Calls f(entity, components...) for every matching entity
+	template <typename F>
+	void each(F&& f) const
 	{
-		return m_entityMap;
+		chunks([&](const EntityVec& entities)
+		{
+			auto pools = std::make_tuple(m_manager.template components<Ts>()...);
+			for (const Entity& e : entities)
+				f(e, std::get<Ts*>(pools)[e.index()]...);
+		});
 	}
 
+	size_t size() const
+	{
+		size_t count = 0;
+		chunks([&](const EntityVec& entities) { count += entities.size(); });
+		return count;
+	}
 };
 
+template <typename... Ts>
+View<Ts...> EntityManager::view()
+{
+	return View<Ts...>(*this, 0, true);
+}
+
+template <typename... Ts>
+View<Ts...> EntityManager::view(TagId tag)
+{
+	return View<Ts...>(*this, tag, false);
+}
+
 #endif // !ENTITYMANAGER_HPP
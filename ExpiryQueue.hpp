@@ -0,0 +1,77 @@
+#ifndef EXPIRYQUEUE_HPP
+#define EXPIRYQUEUE_HPP
+
+#include "EntityManager.hpp"
+#include <vector>
+#include <algorithm>
+
+// Timing wheel of entities keyed by the tick they expire on, used by sLifespan.
+// Each tick only its own bucket is looked at, so expiring costs O(expiring) instead of a
+// scan over every entity. Lifespans longer than the wheel wrap around and wait in their
+// bucket for the right lap, that only costs a skipped entry per lap.
+// Entries are never removed early: an entity that dies some other way stays in its bucket
+// until its tick comes up, and its handle is checked then (a recycled slot has a new generation).
+class ExpiryQueue
+{
+	struct Entry
+	{
+		int		tick;
+		Entity	entity;
+	};
+
+	static constexpr int			BUCKETS = 128;	// power of two, more than any configured lifespan
+
+	std::vector<std::vector<Entry>>	m_buckets;		// bucket of a tick is tick & (BUCKETS - 1)
+	int								m_next{ 0 };	// first tick not processed yet
+	size_t							m_size{ 0 };
+
+public:
+	ExpiryQueue()
+		: m_buckets(BUCKETS) {}
+
+	void push(Entity entity, int tick)
+	{
+		// Anything already overdue goes out with the next pop
+		tick = std::max(tick, m_next);
+		m_buckets[tick & (BUCKETS - 1)].push_back({ tick, entity });
+		m_size++;
+	}
+
+	// Calls f(entity) for every entry due on or before now that is still alive, and drops them
+	template <typename F>
+	void popExpired(int now, F&& f)
+	{
+		if (now < m_next)
+			return;
+
+		// Every bucket between the last call and now, or all of them after a long gap
+		int ticks = std::min(now - m_next + 1, BUCKETS);
+		for (int t = m_next; t < m_next + ticks; ++t)
+		{
+			auto& bucket = m_buckets[t & (BUCKETS - 1)];
+			size_t before = bucket.size();
+			std::erase_if(bucket, [&](const Entry& entry)
+			{
+				if (entry.tick > now)
+					return false;
+
+				if (entry.entity.isActive())
+					f(entry.entity);
+				return true;
+			});
+			m_size -= before - bucket.size();
+		}
+		m_next = now + 1;
+	}
+
+	size_t size() const { return m_size; }
+
+	void clear()
+	{
+		for (auto& bucket : m_buckets)
+			bucket.clear();
+		m_size = 0;
+	}
+};
+
+#endif
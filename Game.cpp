@@ -1,12 +1,15 @@
 #include "Game.h"
 #include "Random.h"
+#include "Polygons.h"
+#include "Log.h"
 #include <fstream>
+#include <cmath>
+#include <cstdio>
 
-#include <iostream>
 		
 
-Game::Game(const std::string& config)
-	: m_text(m_font), m_high_score_text(m_font)
+Game::Game(const std::string& config, bool headless)
+	: m_text(m_font), m_high_score_text(m_font), m_headless(headless)
 {
 	init(config);
 }
@@ -15,32 +18,116 @@ void Game::init(const std::string& path)
 {
 	// TODO: read in config file here
 	// use premade PlayerConfig, EnemyConfig, and BulletConfig variables
-	std::cout << "Initialzing Game!\n";
+	LOG_INFO("Initialzing Game!");
 
 	std::ifstream config(path);
 	if (config.fail())
 	{
-		std::cout << "Could not open config file!\n"; exit(-1);
+		LOG_ERROR("Could not open config file!"); exit(-1);
 	}
 
 	std::string input_type;
-
-	// Read in window information
 	sf::Vector2u windowSize;
-	int frameLimit;
-	int fullscreen;
-	config >> input_type >> windowSize.x >> windowSize.y >> frameLimit >> fullscreen;
+	int frameLimit = 60;
+	int fullscreen = 0;
+	std::string fontPath;
+	int fontSize = 30, r = 255, g = 255, b = 255;
+	size_t entityCapacity = 1024;
+	size_t workers = 0, parallelThreshold = 2048;
+
+	// Each line starts with its type, so lines can be in any order and optional ones left out
+	while (config >> input_type)
+	{
+		if (input_type == "Window")
+		{
+			// Read in window information
+			config >> windowSize.x >> windowSize.y >> frameLimit >> fullscreen;
+		}
+		else if (input_type == "Font")
+		{
+			// Read in Font
+			config >> fontPath >> fontSize >> r >> g >> b;
+		}
+		else if (input_type == "Player")
+		{
+			// Read in Player config info
+			config >> m_playerConfig.SR >> m_playerConfig.CR >> m_playerConfig.S >> m_playerConfig.FR
+				>> m_playerConfig.FG >> m_playerConfig.FB >> m_playerConfig.OR >> m_playerConfig.OG >> m_playerConfig.OB
+				>> m_playerConfig.OT >> m_playerConfig.V;
+		}
+		else if (input_type == "Enemy")
+		{
+			// Read in Enemy config info
+			config >> m_enemyConfig.SR >> m_enemyConfig.CR >> m_enemyConfig.SMIN >> m_enemyConfig.SMAX
+				>> m_enemyConfig.OR >> m_enemyConfig.OG >> m_enemyConfig.OB >> m_enemyConfig.OT >> m_enemyConfig.VMIN
+				>> m_enemyConfig.VMAX >> m_enemyConfig.L >> m_enemyConfig.SI;
+		}
+		else if (input_type == "Bullet")
+		{
+			// Read in Bullet config info
+			config >> m_bulletConfig.SR >> m_bulletConfig.CR >> m_bulletConfig.S >> m_bulletConfig.FR
+				>> m_bulletConfig.FG >> m_bulletConfig.FB >> m_bulletConfig.OR >> m_bulletConfig.OG >> m_bulletConfig.OB
+				>> m_bulletConfig.OT >> m_bulletConfig.V >> m_bulletConfig.L;
+		}
+		else if (input_type == "Entities")
+		{
+			// Number of entity slots to allocate up front
+			config >> entityCapacity;
+		}
+		else if (input_type == "Tick")
+		{
+			// Simulation rate in ticks per second, and how many ticks one frame may run to catch up
+			config >> m_tickRate >> m_maxTicksPerFrame;
+		}
+		else if (input_type == "Collision")
+		{
+			// Broadphase backend: brute, grid or sap
+			std::string backend;
+			config >> backend;
+			if (backend == "brute")
+				m_collisionBackend = CollisionBackend::BruteForce;
+			else if (backend == "grid")
+				m_collisionBackend = CollisionBackend::Grid;
+			else if (backend == "sap")
+				m_collisionBackend = CollisionBackend::SweepAndPrune;
+			else
+				LOG_WARNING("Unknown collision backend \"%s\", using the grid", backend.c_str());
+		}
+		else if (input_type == "Log")
+		{
+			// Lowest level printed: debug, info, warning, error or off
+			std::string level;
+			config >> level;
+			Log::Level parsed;
+			if (Log::parse(level.c_str(), parsed))
+				Log::level = parsed;
+			else
+				LOG_WARNING("Unknown log level \"%s\", keeping %s", level.c_str(), Log::name(Log::level));
+		}
+		else if (input_type == "Threads")
+		{
+			// Worker threads (0 = one per extra core) and the smallest entity list worth splitting
+			config >> workers >> parallelThreshold;
+		}
+		else
+		{
+			LOG_WARNING("Unknown config line \"%s\", skipping it", input_type.c_str());
+			std::getline(config, input_type);
+		}
+	}
+
+	// The play field matches the window, but is kept separately so headless runs don't need one
+	m_arenaSize = windowSize;
 	
 	//set up window default parameters
-	m_window.create(sf::VideoMode(windowSize), "Geometry Wars", static_cast<sf::State>(fullscreen));
-	m_window.setFramerateLimit(frameLimit);
-	ImGui::SFML::Init(m_window);
+	if (!m_headless)
+	{
+		m_window.create(sf::VideoMode(windowSize), "Geometry Wars", static_cast<sf::State>(fullscreen));
+		m_window.setFramerateLimit(frameLimit);
+		ImGui::SFML::Init(m_window);
+	}
 
-	// Read in Font
-	std::string fontPath;
-	int fontSize, r, g, b;
-	config >> input_type >> fontPath >> fontSize >> r >> g >> b;
-	if (!m_font.openFromFile(fontPath))
+	if (!m_headless && !m_font.openFromFile(fontPath))
 	{
 		exit(-1);
 	};
@@ -49,20 +136,14 @@ void Game::init(const std::string& path)
 	m_text.setFillColor(sf::Color(r, g, b));
 	m_text.setPosition({ 5, 0 });
 
-	// Read in Player config info
-	config >> input_type >> m_playerConfig.SR >> m_playerConfig.CR >> m_playerConfig.S >> m_playerConfig.FR
-		>> m_playerConfig.FG >> m_playerConfig.FB >> m_playerConfig.OR >> m_playerConfig.OG >> m_playerConfig.OB
-		>> m_playerConfig.OT >> m_playerConfig.V;
+	m_entities.reserve(entityCapacity);
+	m_jobs.start(workers, parallelThreshold);
 
-	// Read in Enemy config info
-	config >> input_type >> m_enemyConfig.SR >> m_enemyConfig.CR >> m_enemyConfig.SMIN >> m_enemyConfig.SMAX
-		>> m_enemyConfig.OR >> m_enemyConfig.OG >> m_enemyConfig.OB >> m_enemyConfig.OT >> m_enemyConfig.VMIN
-		>> m_enemyConfig.VMAX >> m_enemyConfig.L >> m_enemyConfig.SI;
-
-	// Read in Bullet config info
-	config >> input_type >> m_bulletConfig.SR >> m_bulletConfig.CR >> m_bulletConfig.S >> m_bulletConfig.FR
-		>> m_bulletConfig.FG >> m_bulletConfig.FB >> m_bulletConfig.OR >> m_bulletConfig.OG >> m_bulletConfig.OB
-		>> m_bulletConfig.OT >> m_bulletConfig.V >> m_bulletConfig.L;
+	// Build the unit polygons for every point count in use, plus the enemy spawn directions
+	Polygons::warm(m_enemyConfig.VMIN, m_enemyConfig.VMAX);
+	Polygons::get(m_playerConfig.V);
+	Polygons::get(m_bulletConfig.V);
+	Polygons::get(360);
 
 	config.close();
 
@@ -75,24 +156,47 @@ void Game::init(const std::string& path)
 	score.close();
 
 	//Scale imgui ui and text size by 2
-	ImGui::GetStyle().ScaleAllSizes(2.0f);
-	ImGui::GetIO().FontGlobalScale = 2.0f;
+	if (!m_headless)
+	{
+		ImGui::GetStyle().ScaleAllSizes(2.0f);
+		ImGui::GetIO().FontGlobalScale = 2.0f;
+	}
+
+	// Register the entity tags once, everything else refers to them by id
+	m_tags.player = m_entities.registerTag("player");
+	m_tags.enemy = m_entities.registerTag("enemy");
+	m_tags.sEnemy = m_entities.registerTag("sEnemy");
+	m_tags.bullet = m_entities.registerTag("bullet");
+
+	Trace::nameThread("Main");
+
+	// Profiler sections, in the order they are stacked in the Profiler tab
+	m_profile.entities = m_profiler.add("EntityManager");
+	m_profile.spawner = m_profiler.add("Spawner");
+	m_profile.movement = m_profiler.add("Movement");
+	m_profile.collision = m_profiler.add("Collision");
+	m_profile.lifespan = m_profiler.add("Lifespan");
+	m_profile.input = m_profiler.add("Input");
+	m_profile.gui = m_profiler.add("GUI");
+	m_profile.render = m_profiler.add("Render");
+
+	// Everything random in the game comes from this seed, replay() swaps in the recorded one
+	seed(Random::makeSeed());
 
-	std::cout << "Spawning Player!\n";
+	LOG_INFO("Spawning Player!");
 	spawnPlayer();
 
 }
 
 
-// Helper function that returns the player via entity manager
-std::shared_ptr<Entity> Game::player()
+// Helper function that returns the player, respawning it once the old one has been removed
+Entity Game::player()
 {
-	auto& players = m_entities.getEntities("player");
-	if (players.empty())
+	if (!m_player.isValid())
 	{
 		spawnPlayer();
 	};
-	return players.front();
+	return m_player;
 }
 
 void Game::run()
@@ -101,29 +205,36 @@ void Game::run()
 	// some systems should function while paused (rendering)
 	// some systems shouldn't (movement/input)
 
+	const float tick = 1.0f / m_tickRate;
+
 	while (m_running)
 	{
+		m_profiler.beginFrame();
+		sf::Time frameTime = m_deltaClock.restart();
 
 		// required update call to igui
-		ImGui::SFML::Update(m_window, m_deltaClock.restart());
+		ImGui::SFML::Update(m_window, frameTime);
 
 		// Call our systems
 
-		// if not paused
+		// if not paused, run as many fixed ticks as the frame took. Velocities, lifespans and
+		// spawn intervals are all per tick, so the game plays the same at any frame rate
+		m_ticksLastFrame = 0;
 		if (!m_paused)
 		{
-			// update entity manager
-			m_entities.update();
-
-			sEnemySpawner();
-			sMovement();
-			sCollision();
-			sLifespan();
-
-			// increase current frame
-			m_currentFrame++;
-			if (m_score > m_high_score)
-				m_high_score = m_score;
+			m_accumulator += frameTime.asSeconds();
+			while (m_accumulator >= tick && m_ticksLastFrame < m_maxTicksPerFrame)
+			{
+				update();
+				m_accumulator -= tick;
+				m_ticksLastFrame++;
+			}
+
+			// Too far behind to catch up, slow the game down instead of spiralling
+			if (m_accumulator >= tick)
+				m_accumulator = std::fmod(m_accumulator, tick);
+
+			m_interpolation = m_accumulator / tick;
 		}
 		
 		sUserInput();
@@ -137,27 +248,149 @@ void Game::run()
 	// Cleanup 
 	
 	score.close();
+	if (m_recorder.isOpen())
+	{
+		LOG_INFO("Recorded %zu ticks", m_recorder.ticks());
+		m_recorder.close();
+	}
 	m_window.close();
 	ImGui::SFML::Shutdown();
 }
 
+// Advances the game logic by one frame
+void Game::update()
+{
+	applyInput();
+
+	// update entity manager
+	{
+		PROFILE_SCOPE(m_profiler, m_profile.entities);
+		m_entities.update();
+	}
+
+	sEnemySpawner();
+	sMovement();
+	sCollision();
+	sLifespan();
+
+	// increase current frame
+	m_currentFrame++;
+	if (m_score > m_high_score)
+		m_high_score = m_score;
+}
+
+// Runs the simulation systems for a fixed number of frames as fast as possible,
+// without input, GUI or rendering. Used for measuring simulation throughput.
+double Game::step(int frames)
+{
+	sf::Clock clock;
+
+	for (int i = 0; i < frames; ++i)
+	{
+		m_profiler.beginFrame();
+		update();
+	}
+
+	float seconds = clock.getElapsedTime().asSeconds();
+	double fps = seconds > 0.0f ? frames / seconds : 0.0;
+
+	LOG_INFO("Simulated %d frames in %gs (%g fps, %zu entities)", frames, seconds, fps, m_entities.getEntities().size());
+
+	return fps;
+}
+
+// Input collected since the last tick takes effect here, at the start of a tick, which is
+// also where the recording stores it and where a replay feeds it back in
+void Game::applyInput()
+{
+	if (m_recorder.isOpen())
+		m_recorder.write(player().get<CInput>(), m_pendingInput);
+
+	for (auto& event : m_pendingInput)
+	{
+		if (event.applied)
+			continue;
+
+		switch (event.type)
+		{
+		case InputEvent::Shoot:
+			spawnBullet(player(), event.target);
+			break;
+		case InputEvent::Special:
+			spawnSpecialWeapon(player());
+			break;
+		case InputEvent::SpawnEnemy:
+			spawnEnemy();
+			break;
+		}
+	}
+	m_pendingInput.clear();
+}
+
+void Game::seed(uint64_t value)
+{
+	m_seed = value;
+	Random::seed(value);
+	m_spawnRng = Random::stream(Random::Spawning);
+}
+
+void Game::record(const std::string& path)
+{
+	if (!m_recorder.open(path, m_seed))
+	{
+		LOG_ERROR("Could not open replay file %s for writing!", path.c_str()); exit(-1);
+	}
+	LOG_INFO("Recording to %s (seed %llu)", path.c_str(), static_cast<unsigned long long>(m_seed));
+}
+
+void Game::replay(const std::string& path)
+{
+	Replay::Reader reader;
+	if (!reader.open(path))
+	{
+		LOG_ERROR("Could not read replay file %s!", path.c_str()); exit(-1);
+	}
+
+	seed(reader.seed());
+
+	sf::Clock clock;
+	int ticks = 0;
+	while (reader.next(player().get<CInput>(), m_pendingInput))
+	{
+		m_profiler.beginFrame();
+		update();
+		ticks++;
+	}
+
+	float seconds = clock.getElapsedTime().asSeconds();
+	LOG_INFO("Replayed %d ticks in %gs (%g ticks/s, %g ms per tick)", ticks, seconds,
+		seconds > 0.0f ? ticks / seconds : 0.0f, ticks > 0 ? seconds * 1000.0f / ticks : 0.0f);
+	LOG_INFO("Final score: %ld", m_score);
+
+	std::string entities = "Entities: " + std::to_string(m_entities.getEntities().size());
+	for (TagId tag = 0; tag < m_entities.tagCount(); ++tag)
+		entities += ", " + m_entities.tagName(tag) + " " + std::to_string(m_entities.getEntities(tag).size());
+	LOG_INFO("%s", entities.c_str());
+}
+
 void Game::spawnPlayer()
 {
 	// TODO: Finish adding all properties of player with correct values
-	auto entity = m_entities.addEntity("player");
+	auto entity = m_entities.addEntity(m_tags.player);
+	m_player = entity;
 
 	// Give the entity a transform with position, velocity, and angle
-	entity->add<CTransform>(Vec2f(m_window.getSize().x/2, m_window.getSize().y/2), Vec2f(0.0f, 0.0f), 0.0f);
+	entity.add<CTransform>(Vec2f(m_arenaSize.x/2, m_arenaSize.y/2), Vec2f(0.0f, 0.0f), 0.0f);
 
 	// Give the entity a shape with radius, number of sides, fill color, outline color and thickness
-	entity->add<CShape>(m_playerConfig.SR, m_playerConfig.V, sf::Color(m_playerConfig.FR, m_playerConfig.FG, m_playerConfig.FB), 
+	entity.add<CShape>(m_playerConfig.SR, m_playerConfig.V, sf::Color(m_playerConfig.FR, m_playerConfig.FG, m_playerConfig.FB), 
 						sf::Color(m_playerConfig.OR, m_playerConfig.OG, m_playerConfig.OB), m_playerConfig.OT);
 
 	// Add input component
-	entity->add<CInput>();
+	entity.add<CInput>();
 
 	// Add collision component
-	entity->add<CCollision>(m_playerConfig.CR);
+	entity.add<CCollision>(m_playerConfig.CR);
 
 }
 
@@ -166,45 +399,42 @@ void Game::spawnEnemy()
 	// TODO: make sure enemy is spawned properly with the m_enemyConfig variables
 	
 	// enemy mmust be spawned within bounds of window and not on top of player
-	auto entity = m_entities.addEntity("enemy");
+	auto entity = m_entities.addEntity(m_tags.enemy);
 
 	// Assign enemy random position within bounds and speed
-	int rand_xpos = Random::get(0 + m_enemyConfig.SR, m_window.getSize().x - m_enemyConfig.SR);
-	int rand_ypos = Random::get(0 + m_enemyConfig.SR, m_window.getSize().y - m_enemyConfig.SR);
+	int rand_xpos = m_spawnRng.get(0 + m_enemyConfig.SR, m_arenaSize.x - m_enemyConfig.SR);
+	int rand_ypos = m_spawnRng.get(0 + m_enemyConfig.SR, m_arenaSize.y - m_enemyConfig.SR);
 
 	// Assign random speed between min/max values
-	float rand_speed = Random::get(m_enemyConfig.SMIN, m_enemyConfig.SMAX);
+	float rand_speed = m_spawnRng.get(m_enemyConfig.SMIN, m_enemyConfig.SMAX);
 
-	// Choose random direction
-	float degrees = Random::get(0.0f, 6.18f);
+	// Choose random direction, one of the corners of a 360-gon so no trig is needed
+	const Polygons::Polygon& directions = Polygons::get(360);
+	Vec2f direction = directions.corners[m_spawnRng.below(360)];
 
-	float x_speed = cos(degrees) * rand_speed;
-	float y_speed = sin(degrees) * rand_speed;
-
-	entity->add<CTransform>(Vec2f(rand_xpos, rand_ypos), Vec2f(x_speed, y_speed), 0.0f);
+	entity.add<CTransform>(Vec2f(rand_xpos, rand_ypos), direction * rand_speed, 0.0f);
 
 	// Give entity a shape with radius, rand number of vertices, random fill color, outline color
-	int rand_vertices = Random::get(m_enemyConfig.VMIN, m_enemyConfig.VMAX);
+	int rand_vertices = m_spawnRng.get(m_enemyConfig.VMIN, m_enemyConfig.VMAX);
 
-	int r = Random::get(0, 255);
-	int g = Random::get(0, 255);
-	int b = Random::get(0, 255);
+	int rgb[3];
+	m_spawnRng.fill(rgb, 3, 0, 255);
 
-	entity->add<CShape>(m_enemyConfig.SR, rand_vertices, sf::Color(r, g, b), sf::Color(m_enemyConfig.OR,
+	entity.add<CShape>(m_enemyConfig.SR, rand_vertices, sf::Color(rgb[0], rgb[1], rgb[2]), sf::Color(m_enemyConfig.OR,
 						m_enemyConfig.OG, m_enemyConfig.OB), m_enemyConfig.OT);
 
 	// Add score componenet
-	entity->add<CScore>(100 * rand_vertices);
+	entity.add<CScore>(100 * rand_vertices);
 
 	//Add collision component
-	entity->add<CCollision>(m_enemyConfig.CR);
+	entity.add<CCollision>(m_enemyConfig.CR);
 
 	// Record when most recent enemy was spawned
 	m_lastEnemySpawnTime = m_currentFrame;
 
 }
 
-void Game::spawnSmallEnemies(std::shared_ptr<Entity> e)
+void Game::spawnSmallEnemies(Entity e)
 {
 	// TODO: spawn small enemies at the location of input enemy e
 
@@ -214,45 +444,50 @@ void Game::spawnSmallEnemies(std::shared_ptr<Entity> e)
 	// small enemies are worth double the points
 
 	
-	float base_speed = sqrt(pow(e->get<CTransform>().velocity.x, 2) + pow(e->get<CTransform>().velocity.y, 2));
-	Vec2f base_position = e->get<CTransform>().pos;
-	float base_radius = e->get<CShape>().circle.getRadius();
+	float base_speed = sqrt(pow(e.get<CTransform>().velocity.x, 2) + pow(e.get<CTransform>().velocity.y, 2));
+	Vec2f base_position = e.get<CTransform>().pos;
+	float base_radius = e.get<CShape>().radius;
+
+	sf::Color fill = e.get<CShape>().fillColor();
+	sf::Color outline = e.get<CShape>().outlineColor();
 
-	sf::Color fill = e->get<CShape>().circle.getFillColor();
-	sf::Color outline = e->get<CShape>().circle.getOutlineColor();
+	int num_vertices = e.get<CShape>().points;
 
-	int num_vertices = e->get<CShape>().circle.getPointCount();
-	float angle = e->get<CTransform>().angle;
+	// The fragments fly out evenly spaced around the circle, starting at the enemy's angle.
+	// The unit polygon starts pointing up, so rotate it by angle + 90 degrees, once for all fragments.
+	const Polygons::Polygon& polygon = Polygons::get(num_vertices);
+	float angle = e.get<CTransform>().angle + 1.5707963f;
+	float c = cos(angle), s = sin(angle);
 
 	for (int i = 0; i < num_vertices; ++i)
 	{
 		// Create entity
-		auto entity = m_entities.addEntity("sEnemy");
+		auto entity = m_entities.addEntity(m_tags.sEnemy);
+
+		const Vec2f& unit = polygon.corners[i];
+		Vec2f direction(unit.x * c - unit.y * s, unit.x * s + unit.y * c);
 
 		//Calcualte spawn point
-		float x_spawn = base_position.x + cos(angle) * (base_radius);
-		float y_spawn = base_position.y + sin(angle) * (base_radius);
+		float x_spawn = base_position.x + direction.x * base_radius;
+		float y_spawn = base_position.y + direction.y * base_radius;
 
 		// Calculate velocity
-		float x_speed = cos(angle) * base_speed;
-		float y_speed = sin(angle) * base_speed;
+		float x_speed = direction.x * base_speed;
+		float y_speed = direction.y * base_speed;
 
 		// Add components
-		entity->add<CTransform>(Vec2f(x_spawn, y_spawn), Vec2f(x_speed, y_speed), 0.0f);
-		entity->add<CShape>(base_radius / 2, num_vertices, fill, outline, m_enemyConfig.OT);
-		entity->add<CLifespan>(m_enemyConfig.L);
-		entity->add<CCollision>(e->get<CCollision>().radius / 2);
-		entity->add<CScore>(e->get<CScore>().score * 2);
-
-		// Adjust angle for next enemy
-		angle += 6.18 / num_vertices;
+		entity.add<CTransform>(Vec2f(x_spawn, y_spawn), Vec2f(x_speed, y_speed), 0.0f);
+		entity.add<CShape>(base_radius / 2, num_vertices, fill, outline, m_enemyConfig.OT);
+		addLifespan(entity, m_enemyConfig.L);
+		entity.add<CCollision>(e.get<CCollision>().radius / 2);
+		entity.add<CScore>(e.get<CScore>().score * 2);
 	}
 
 
 }
 
 // spawns a bullet from a given entity to target location
-void Game::spawnBullet(std::shared_ptr<Entity> entity, const Vec2f& target)
+void Game::spawnBullet(Entity entity, const Vec2f& target)
 {
 	if (m_paused)
 		return;
@@ -261,7 +496,7 @@ void Game::spawnBullet(std::shared_ptr<Entity> entity, const Vec2f& target)
 		// set velocity using trig formulas
 
 	// Calculate angle between mouse and player
-	Vec2f player_position = entity->get<CTransform>().pos;
+	Vec2f player_position = entity.get<CTransform>().pos;
 	
 	float x_dist = target.x - player_position.x;
 	float y_dist = target.y - player_position.y;
@@ -272,71 +507,67 @@ void Game::spawnBullet(std::shared_ptr<Entity> entity, const Vec2f& target)
 	float x_vel = cos(angle) * m_bulletConfig.S;
 	float y_vel = sin(angle) * m_bulletConfig.S;
 
-	float x_spawn = entity->get<CTransform>().pos.x + cos(angle) * (entity->get<CShape>().circle.getRadius() + m_bulletConfig.SR*1.5);
-	float y_spawn = entity->get<CTransform>().pos.y + sin(angle) * (entity->get<CShape>().circle.getRadius() + m_bulletConfig.SR*1.5);
+	float x_spawn = entity.get<CTransform>().pos.x + cos(angle) * (entity.get<CShape>().radius + m_bulletConfig.SR*1.5);
+	float y_spawn = entity.get<CTransform>().pos.y + sin(angle) * (entity.get<CShape>().radius + m_bulletConfig.SR*1.5);
 
-	auto bullet = m_entities.addEntity("bullet");
-	bullet->add<CTransform>(Vec2f(x_spawn, y_spawn), Vec2f(x_vel, y_vel), 0.0f);
+	auto bullet = m_entities.addEntity(m_tags.bullet);
+	bullet.add<CTransform>(Vec2f(x_spawn, y_spawn), Vec2f(x_vel, y_vel), 0.0f);
 
 	// Add shape component
-	bullet->add<CShape>(m_bulletConfig.SR, m_bulletConfig.V, sf::Color(m_bulletConfig.FR, m_bulletConfig.FG, m_bulletConfig.FB, 255),
+	bullet.add<CShape>(m_bulletConfig.SR, m_bulletConfig.V, sf::Color(m_bulletConfig.FR, m_bulletConfig.FG, m_bulletConfig.FB, 255),
 						sf::Color(m_bulletConfig.OR, m_bulletConfig.OG, m_bulletConfig.OB), m_bulletConfig.OT);
 
 	// Add collision and lifespan components
-	bullet->add<CCollision>(m_bulletConfig.CR);
-	bullet->add<CLifespan>(m_bulletConfig.L);
+	bullet.add<CCollision>(m_bulletConfig.CR);
+	addLifespan(bullet, m_bulletConfig.L);
 
 }
 
-void Game::spawnSpecialWeapon(std::shared_ptr<Entity> entity)
+void Game::spawnSpecialWeapon(Entity entity)
 {
 
 }
 
 void Game::sMovement()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.movement);
 	if (!m_systems.movement)
-		return;
-
-	// TODO: implement all movement in this function
-	// Bullet movement
-	for (auto& bullet : m_entities.getEntities("bullet"))
 	{
-		bullet->get<CTransform>().pos += bullet->get<CTransform>().velocity;
-	}
-
-	// Enemy Movement
-	for (auto& enemy : m_entities.getEntities("enemy"))
-	{
-		Vec2f& pos = enemy->get<CTransform>().pos;
-		Vec2f& vel = enemy->get<CTransform>().velocity;
-		float radius = enemy->get<CCollision>().radius;
-
-		pos += vel;
-
-		// Bounce off walls
-		if (pos.x + radius >= m_window.getSize().x || pos.x - radius <= 0)
-			vel.x *= -1;
-
-		if (pos.y + radius >= m_window.getSize().y || pos.y - radius <= 0)
-			vel.y *= -1;
-			
-		enemy->get<CTransform>().angle += 2.5f;
+		// Nothing moves, so there is nothing to interpolate or sweep across either
+		m_entities.view<CTransform>().each([](Entity, CTransform& transform)
+		{
+			transform.prevPos = transform.pos;
+			transform.prevAngle = transform.angle;
+		});
+		return;
 	}
 
-	// Small enemy Movement
-	for (auto& sEnemy : m_entities.getEntities("sEnemy"))
+	// TODO: implement all movement in this function
+	// Bullets fly straight, enemies spin and bounce off the walls, small enemies just spin.
+	// Entities don't affect each other here, so long lists are split over the worker threads.
+	// The archetype lists are sorted by slot, so the transforms are read in increasing order
+	auto integrate = [&](TagId tag, const Movement::Params& params)
 	{
-		sEnemy->get<CTransform>().pos += sEnemy->get<CTransform>().velocity;
-		sEnemy->get<CTransform>().angle += 2.5f;
-	}
+		m_entities.view<CTransform>(tag).chunks([&](const EntityVec& entities)
+		{
+			m_jobs.parallelFor(entities.size(), [&](size_t begin, size_t end)
+			{
+				Movement::integrate(m_entities, entities.data() + begin, end - begin, params, m_movementIsa);
+			});
+		});
+	};
+	integrate(m_tags.bullet, { 0.0f, nullptr });
+	integrate(m_tags.enemy, { 2.5f, &m_arenaSize });
+	integrate(m_tags.sEnemy, { 2.5f, nullptr });
 
 	// Player movement based on input
-	auto& transform = player()->get<CTransform>();
+	auto& transform = player().get<CTransform>();
+	transform.prevPos = transform.pos;
+	transform.prevAngle = transform.angle;
 	
 	// Vertical/horizontal speed
-	transform.velocity.y = 10 * player()->get<CInput>().down - (10 * player()->get<CInput>().up);
-	transform.velocity.x = 10 * player()->get<CInput>().right - (10 * player()->get<CInput>().left);
+	transform.velocity.y = 10 * player().get<CInput>().down - (10 * player().get<CInput>().up);
+	transform.velocity.x = 10 * player().get<CInput>().right - (10 * player().get<CInput>().left);
 
 	// Diagonal speed
 	if (transform.velocity.x != 0 && transform.velocity.y != 0)
@@ -345,19 +576,19 @@ void Game::sMovement()
 		transform.velocity.x *= sqrt(2) / 2; 
 	}
 
-	float player_rad = player()->get<CCollision>().radius;
+	float player_rad = player().get<CCollision>().radius;
 
 	// Adjust position and angle
 	transform.pos += transform.velocity;
 
 	// Stop player from going outside window
-	if (transform.pos.x + player_rad > m_window.getSize().x)
-		transform.pos.x = m_window.getSize().x - player_rad;
+	if (transform.pos.x + player_rad > m_arenaSize.x)
+		transform.pos.x = m_arenaSize.x - player_rad;
 	else if (transform.pos.x - player_rad < 0)
 		transform.pos.x = player_rad;
 
-	if (transform.pos.y + player_rad > m_window.getSize().y)
-		transform.pos.y = m_window.getSize().y - player_rad;
+	if (transform.pos.y + player_rad > m_arenaSize.y)
+		transform.pos.y = m_arenaSize.y - player_rad;
 	else if (transform.pos.y - player_rad < 0)
 		transform.pos.y = player_rad;
 
@@ -367,127 +598,292 @@ void Game::sMovement()
 
 void Game::sLifespan()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.lifespan);
 	if (!m_systems.lifespan)
 		return;
-	//TODO: implement all lifespan functionality
 
-		// for all entities
-			// if entity has no lifespan, skip
-			// if entity has > 0 remaining lifespan, skip it
-			// if it has lifespan and is alive
-				// scale alpha channel properly
-			// if it has lifespan and its time is up
-				// destroy the entity
+	// Only the entities whose time is up are touched, the fading is done by the renderer.
+	// The clock stops while the system is off, so lifespans are frozen rather than running out
+	m_expiry.popExpired(m_lifespanTick, [](Entity e) { e.destroy(); });
+	m_lifespanTick++;
+}
 
-	for (auto& e: m_entities.getEntities())
-	{
-		if (e->has<CLifespan>())
-		{
-			if (e->get<CLifespan>().remaining > 1)
-			{
-				e->get<CLifespan>().remaining += -1;
-				sf::Color cur_col = e->get<CShape>().circle.getFillColor();
-				sf::Color outline_col = e->get<CShape>().circle.getOutlineColor();
-				float alpha = static_cast<float>(e->get<CLifespan>().remaining) / static_cast<float>(e->get<CLifespan>().lifespan) * 255.0f;
-				e->get<CShape>().circle.setFillColor({ cur_col.r, cur_col.g, cur_col.b, static_cast<uint8_t>(alpha) });
-				e->get<CShape>().circle.setOutlineColor({ outline_col.r, outline_col.g, outline_col.b, static_cast<uint8_t>(alpha) });
-			}
+// Gives an entity ticks to live from now, sLifespan destroys it when they run out
+void Game::addLifespan(Entity entity, int ticks)
+{
+	entity.add<CLifespan>(ticks, m_lifespanTick);
+	m_expiry.push(entity, m_lifespanTick + ticks);
+}
 
-			else
-				e->destroy();
-		}
-	}
 
+// Calls f with the index of every entity in entities that may collide with entity, using the
+// selected broadphase. The grid must have been built from entities this frame.
+// Stops early and returns true as soon as f returns true.
+template <typename F>
+bool Game::forEachCandidate(const SpatialGrid& grid, const SweepAndPrune& sap, const EntityVec& entities, const Vec2f& pos, float radius, F&& f)
+{
+	if (m_collisionBackend == CollisionBackend::Grid)
+		return grid.query(pos, radius, f);
 
+	if (m_collisionBackend == CollisionBackend::SweepAndPrune)
+		return sap.query(pos, radius, f);
 
+	// Brute force: every entity is a candidate
+	for (size_t i = 0; i < entities.size(); ++i)
+	{
+		if (f(i))
+			return true;
+	}
+	return false;
 }
 
-
 void Game::sCollision()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.collision);
 	if (!m_systems.collision)
 		return;
 
 	// TODO: implement all proper collisions between entities
 		//	be sure to use collision radius
 
-	// Check all bullet collisions
-	for (auto b : m_entities.getEntities("bullet"))
+	// Only entities with a transform and a collision radius take part
+	auto gather = [&](TagId tag, EntityVec& out) -> const EntityVec&
 	{
-		// If bullet hits enemies
-		for (auto e : m_entities.getEntities("enemy"))
+		out.clear();
+		m_entities.view<CTransform, CCollision>(tag).chunks([&](const EntityVec& entities)
 		{
-			if (checkCollision(b, e))
-			{
-				spawnSmallEnemies(e);
-				m_score += e->get<CScore>().score;
-				e->destroy();
-				b->destroy();
-				break;
-			}
+			out.insert(out.end(), entities.begin(), entities.end());
+		});
+		return out;
+	};
+	auto& enemies = gather(m_tags.enemy, m_collisionEnemies);
+	auto& sEnemies = gather(m_tags.sEnemy, m_collisionSEnemies);
 
+	if (m_collisionBackend == CollisionBackend::Grid)
+	{
+		m_enemyGrid.build(enemies, m_arenaSize);
+		m_sEnemyGrid.build(sEnemies, m_arenaSize);
+	}
+	else if (m_collisionBackend == CollisionBackend::SweepAndPrune)
+	{
+		m_enemySap.build(enemies);
+		m_sEnemySap.build(sEnemies);
+	}
+	else
+	{
+		// Brute force tests every bullet against everything, so pack it all once
+		m_enemyCircles.clear();
+		m_sEnemyCircles.clear();
+		for (size_t j = 0; j < enemies.size(); ++j)
+		{
+			if (enemies[j].isActive())
+				m_enemyCircles.push(enemies[j].get<CTransform>().pos, enemies[j].get<CCollision>().radius, static_cast<uint32_t>(j));
 		}
+		for (size_t j = 0; j < sEnemies.size(); ++j)
+		{
+			if (sEnemies[j].isActive())
+				m_sEnemyCircles.push(sEnemies[j].get<CTransform>().pos, sEnemies[j].get<CCollision>().radius, static_cast<uint32_t>(j));
+		}
+	}
 
-		if (!b->isActive())
-			continue;
+	// Find every bullet overlap on the worker threads. Nothing is changed yet,
+	// each task just records what it found in its own list
+	auto& bullets = gather(m_tags.bullet, m_collisionBullets);
+	size_t grain = m_jobs.grain(bullets.size());
+	m_collisionTasks.resize((bullets.size() + grain - 1) / grain);
+	for (auto& task : m_collisionTasks)
+		task.hits.clear();
 
-		// If bullet hits small enemies
-		for (auto e : m_entities.getEntities("sEnemy"))
+	std::atomic<size_t> pairTests{ 0 };
+	m_jobs.parallelFor(bullets.size(), [&](size_t begin, size_t end)
+	{
+		auto& task = m_collisionTasks[begin / grain];
+		size_t tests = 0;
+		for (size_t i = begin; i < end; ++i)
 		{
-			if (checkCollision(b, e))
+			// Bullets are tested along the whole path they flew this tick, so fast ones or long
+			// ticks can't skip past an enemy. The broadphase gets a circle around the path
+			auto b = bullets[i];
+			const auto& transform = b.get<CTransform>();
+			Vec2f start = transform.prevPos;
+			Vec2f path = transform.pos - transform.prevPos;
+			float radius = b.get<CCollision>().radius;
+			Vec2f centre = start + path / 2.0f;
+			float reach = radius + std::hypot(path.x, path.y) / 2.0f;
+
+			// Pack what the broadphase returns and test it in one batch, only the hits
+			// are looked at again to find when the bullet got there
+			auto test = [&](const SpatialGrid& grid, const SweepAndPrune& sap, const EntityVec& targets, const Narrowphase::Circles& all, bool small)
 			{
-				m_score += e->get<CScore>().score;
-				e->destroy();
-				b->destroy();
+				const Narrowphase::Circles* circles = &all;
+				if (m_collisionBackend != CollisionBackend::BruteForce)
+				{
+					task.candidates.clear();
+					forEachCandidate(grid, sap, targets, centre, reach, [&](size_t j)
+					{
+						if (targets[j].isActive())
+							task.candidates.push(targets[j].get<CTransform>().pos, targets[j].get<CCollision>().radius, static_cast<uint32_t>(j));
+						return false;
+					});
+					circles = &task.candidates;
+				}
+
+				tests += circles->size();
+				if (Narrowphase::sweep(start, path, radius, *circles, task.mask, m_narrowphaseIsa) == 0)
+					return;
+
+				Narrowphase::forEachHit(task.mask, [&](size_t k)
+				{
+					uint32_t j = circles->index[k];
+					float time = 0.0f;
+					if (checkSweptCollision(start, path, radius, targets[j], time))
+						task.hits.push_back({ static_cast<uint32_t>(i), j, small, time });
+				});
+			};
+
+			size_t first = task.hits.size();
+			test(m_enemyGrid, m_enemySap, enemies, m_enemyCircles, false);
+
+			// The enemy the bullet reached first is the one it hits
+			std::sort(task.hits.begin() + first, task.hits.end(), [](const bulletHit& a, const bulletHit& b) { return a.time < b.time; });
+
+			test(m_sEnemyGrid, m_sEnemySap, sEnemies, m_sEnemyCircles, true);
+		}
+		pairTests += tests;
+	});
+
+	m_collisionStats.pairTests = pairTests;
+	m_collisionStats.hits = 0;
+	for (auto& task : m_collisionTasks)
+		m_collisionStats.hits += task.hits.size();
+
+	// Apply the hits in bullet order, so the outcome doesn't depend on the number of threads.
+	// A bullet destroys the first enemy it reaches and nothing else, otherwise every small enemy it overlaps
+	size_t spent = bullets.size();	// last bullet that hit a big enemy
+	for (auto& task : m_collisionTasks)
+	{
+		for (auto& hit : task.hits)
+		{
+			if (hit.bullet == spent)
+				continue;
+
+			auto b = bullets[hit.bullet];
+			auto e = hit.small ? sEnemies[hit.target] : enemies[hit.target];
+			if (!e.isActive())
+				continue;
+
+			if (!hit.small)
+			{
+				spawnSmallEnemies(e);
+				spent = hit.bullet;
 			}
+			m_score += e.get<CScore>().score;
+			e.destroy();
+			b.destroy();
 		}
 	}
 
-	// Check if enemies have hit player
-	for (auto e : m_entities.getEntities("enemy"))
+	// Check if enemies have hit player. The position is copied: a hit moves the player and
+	// spawns fragments, which can reallocate the pools. The player is only hit once per tick,
+	// so both checks stop at the first hit
+	const Vec2f playerPos = player().get<CTransform>().pos;
+	const float playerRadius = player().get<CCollision>().radius;
+	bool playerHit = forEachCandidate(m_enemyGrid, m_enemySap, enemies, playerPos, playerRadius, [&](size_t i)
 	{
+		auto e = enemies[i];
+		if (!e.isActive())
+			return false;
+
+		m_collisionStats.pairTests++;
 		if (checkCollision(e, player()))
 		{
+			m_collisionStats.hits++;
 			spawnSmallEnemies(e);
-			e->destroy();
-			player()->get<CTransform>().pos = Vec2f(m_window.getSize().x / 2, m_window.getSize().y / 2);
+			e.destroy();
+			player().get<CTransform>().pos = player().get<CTransform>().prevPos = Vec2f(m_arenaSize.x / 2, m_arenaSize.y / 2);
 			m_score = 0;
+			return true;
 		}
-	}
+		return false;
+	});
+
+	if (playerHit)
+		return;
 
 	// Check if small enemies have hit player
-	for (auto e : m_entities.getEntities("sEnemy"))
+	forEachCandidate(m_sEnemyGrid, m_sEnemySap, sEnemies, playerPos, playerRadius, [&](size_t i)
 	{
+		auto e = sEnemies[i];
+		if (!e.isActive())
+			return false;
+
+		m_collisionStats.pairTests++;
 		if (checkCollision(e, player()))
 		{
-			e->destroy();
-			player()->get<CTransform>().pos = Vec2f(m_window.getSize().x / 2, m_window.getSize().y / 2);
+			m_collisionStats.hits++;
+			e.destroy();
+			player().get<CTransform>().pos = player().get<CTransform>().prevPos = Vec2f(m_arenaSize.x / 2, m_arenaSize.y / 2);
 			m_score = 0;
+			return true;
 		}
-	}
+		return false;
+	});
 
 }
 
 // Helper function which checks if two entities are colliding
-bool Game::checkCollision(std::shared_ptr<Entity> entity1, std::shared_ptr<Entity> entity2)
+bool Game::checkCollision(Entity entity1, Entity entity2)
 {
 	// Calculate distance between entities
-	double distance = sqrt(pow(entity1->get<CTransform>().pos.x - entity2->get<CTransform>().pos.x, 2) +
-		pow(entity1->get<CTransform>().pos.y - entity2->get<CTransform>().pos.y, 2));
+	double distance = sqrt(pow(entity1.get<CTransform>().pos.x - entity2.get<CTransform>().pos.x, 2) +
+		pow(entity1.get<CTransform>().pos.y - entity2.get<CTransform>().pos.y, 2));
 
 	// Check for collision using distance 
-	if (distance <= entity1->get<CCollision>().radius + entity2->get<CCollision>().radius)
+	if (distance <= entity1.get<CCollision>().radius + entity2.get<CCollision>().radius)
 		return true;
 	else
 		return false;
 
 }
 
+// Whether a circle of the given radius moving from start to start + path this tick touched
+// other anywhere on the way, treating other as standing still.
+// time is how far along the path (0..1) they first touched
+bool Game::checkSweptCollision(const Vec2f& start, const Vec2f& path, float radius, Entity other, float& time)
+{
+	Vec2f offset = start - other.get<CTransform>().pos;
+	radius += other.get<CCollision>().radius;
+
+	// Solve |offset + path * t|^2 = radius^2 for the first t
+	float a = path.x * path.x + path.y * path.y;
+	float b = 2.0f * (offset.x * path.x + offset.y * path.y);
+	float c = offset.x * offset.x + offset.y * offset.y - radius * radius;
+
+	// Already touching at the start
+	if (c <= 0.0f)
+	{
+		time = 0.0f;
+		return true;
+	}
+
+	// Apart and moving away, or not moving
+	if (b >= 0.0f)
+		return false;
+
+	float discriminant = b * b - 4.0f * a * c;
+	if (discriminant < 0.0f)
+		return false;
+
+	time = (-b - std::sqrt(discriminant)) / (2.0f * a);
+	return time >= 0.0f && time <= 1.0f;
+}
+
 
 
 
 void Game::sEnemySpawner()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.spawner);
 	if (!m_systems.spawning)
 		return;
 	
@@ -497,8 +893,75 @@ void Game::sEnemySpawner()
 
 }
 
+// One list of the Entities tab. The rows are formatted from entities at most every
+// m_entityRefresh seconds, in between the cached text is drawn as is and only the
+// rows that are in view are submitted at all
+void Game::drawEntityRows(entityRows& list, const EntityVec& entities)
+{
+	float now = m_guiClock.getElapsedTime().asSeconds();
+	if (now - list.refreshed >= m_entityRefresh)
+	{
+		list.refreshed = now;
+		list.rows.clear();
+		for (auto& e : entities)
+		{
+			if (!e.isActive())
+				continue;
+
+			entityRow row;
+			row.entity = e;
+			row.tag = e.tag();
+			sf::Color col = e.get<CShape>().fillColor();
+			row.color = ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f);
+			Vec2f pos = e.get<CTransform>().pos;
+			std::snprintf(row.id, sizeof(row.id), "%zu", e.id());
+			std::snprintf(row.position, sizeof(row.position), "(%d, %d)", static_cast<int>(pos.x), static_cast<int>(pos.y));
+			list.rows.push_back(row);
+		}
+	}
+
+	float indent = 60.0f;
+	ImGui::Indent();
+	ImGui::PushID(&list);
+
+	ImGuiListClipper clipper;
+	clipper.Begin(static_cast<int>(list.rows.size()));
+	while (clipper.Step())
+	{
+		for (int i = clipper.DisplayStart; i < clipper.DisplayEnd; ++i)
+		{
+			auto& row = list.rows[i];
+			ImGui::PushID(i);
+
+			// Rows can outlive their entity until the next refresh, so only isActive and destroy,
+			// which check the handle, may be called on it here
+			ImGui::BeginDisabled(!row.entity.isActive());
+			ImGui::PushStyleColor(ImGuiCol_Button, row.color);
+			if (ImGui::Button("D", { 30, 40 }))
+			{
+				row.entity.destroy();
+			}
+			ImGui::PopStyleColor();
+			ImGui::EndDisabled();
+
+			ImGui::SameLine(); ImGui::Indent(indent);
+			ImGui::TextUnformatted(row.id);
+			ImGui::SameLine(); ImGui::Indent(indent);
+			ImGui::TextUnformatted(m_entities.tagName(row.tag).c_str());
+			ImGui::SameLine(); ImGui::Indent(indent * 2);
+			ImGui::TextUnformatted(row.position);
+			ImGui::Unindent(4 * indent);
+			ImGui::PopID();
+		}
+	}
+
+	ImGui::PopID();
+	ImGui::Unindent();
+}
+
 void Game::sGUI()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.gui);
 	if (!m_systems.gui)
 		return;
 
@@ -513,180 +976,176 @@ void Game::sGUI()
 		if (ImGui::BeginTabItem("Systems"))
 		{
 			ImGui::Checkbox("Movement", &m_systems.movement);
+			ImGui::Indent();
+			if (ImGui::BeginCombo("SIMD", Movement::name(m_movementIsa)))
+			{
+				for (auto isa : { Movement::Isa::Scalar, Movement::Isa::SSE2 })
+				{
+					if (Movement::supported(isa) && ImGui::Selectable(Movement::name(isa), isa == m_movementIsa))
+						m_movementIsa = isa;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::Unindent();
 			ImGui::Checkbox("Lifespan", &m_systems.lifespan);
 			ImGui::Checkbox("Collision", &m_systems.collision);
+			ImGui::Indent();
+			const char* backends[] = { "Brute Force", "Grid", "Sweep and Prune" };
+			int backend = static_cast<int>(m_collisionBackend);
+			if (ImGui::Combo("Broadphase", &backend, backends, IM_ARRAYSIZE(backends)))
+			{
+				m_collisionBackend = static_cast<CollisionBackend>(backend);
+			}
+			if (ImGui::BeginCombo("Narrowphase", Movement::name(m_narrowphaseIsa)))
+			{
+				for (auto isa : { Movement::Isa::Scalar, Movement::Isa::SSE2, Movement::Isa::AVX2 })
+				{
+					if (Movement::supported(isa) && ImGui::Selectable(Movement::name(isa), isa == m_narrowphaseIsa))
+						m_narrowphaseIsa = isa;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::Text("Pair tests: %zu   Hits: %zu", m_collisionStats.pairTests, m_collisionStats.hits);
+			ImGui::Unindent();
+			ImGui::Text("Worker threads: %zu   Split above: %zu", m_jobs.workerCount(), m_jobs.threshold());
+			if (ImGui::BeginCombo("Log level", Log::name(Log::level)))
+			{
+				for (Log::Level level : { Log::Debug, Log::Info, Log::Warning, Log::Error, Log::Off })
+				{
+					if (ImGui::Selectable(Log::name(level), level == Log::level))
+						Log::level = level;
+				}
+				ImGui::EndCombo();
+			}
+			ImGui::Text("Tick rate: %.0f Hz   Ticks last frame: %d", m_tickRate, m_ticksLastFrame);
 			ImGui::Checkbox("Spawning", &m_systems.spawning);
 			ImGui::Indent();
 			ImGui::SliderInt("Spawn", &m_enemyConfig.SI, 0, 120);
 			if (ImGui::Button("Manual Spawn", { 200, 35 }))
 			{
-				spawnEnemy();
+				// Nothing ticks while paused, so spawn right away as before. The event is still
+				// recorded with the next tick, where a replay spawns it with the same result
+				bool paused = m_paused;
+				if (paused)
+					spawnEnemy();
+				m_pendingInput.push_back({ InputEvent::SpawnEnemy, Vec2f(0.0f, 0.0f), paused });
 			}
 			ImGui::Unindent();
 			ImGui::Checkbox("GUI", &m_systems.gui);
 			ImGui::Checkbox("Rendering", &m_systems.rendering);
+			ImGui::Indent();
+			ImGui::Checkbox("Batched Shapes", &m_systems.batching);
+			ImGui::Text("Draw calls: %zu   Vertices: %zu", m_renderStats.drawCalls, m_renderStats.vertices);
+			ImGui::Unindent();
 			ImGui::EndTabItem();
 		}
 
 		if (ImGui::BeginTabItem("Entities"))
 		{
-			int i = 0;
+			// Entity slot pool occupancy
+			const PoolStats& pool = m_entities.poolStats();
+			ImGui::Text("Pool capacity: %zu   Live: %zu", pool.capacity, pool.live);
+			ImGui::Text("High-water: %zu   Recycled: %zu   Growths: %zu", pool.highWater, pool.recycled, pool.growths);
+			ImGui::Text("Archetypes: %zu", m_entities.archetypeCount());
+			ImGui::Separator();
+
+			// Only the rows in view are drawn, and their text is only redone a few times a second
+			ImGui::SliderFloat("Refresh", &m_entityRefresh, 0.0f, 1.0f, "%.2f s");
 			if (ImGui::CollapsingHeader("Entities"))
 			{
 				ImGui::Indent();
 				if (ImGui::CollapsingHeader("bullet"))
-				{
-					float indent = 60.0f;
-					ImGui::Indent();
-					for (auto& b : m_entities.getEntities("bullet"))
-					{
-						ImGui::PushID(i++);
-
-						sf::Color col = b->get<CShape>().circle.getFillColor();
-						sf::Vector2f pos = b->get<CShape>().circle.getPosition();
-						std::string position = "(" + std::to_string(static_cast<int>(pos.x)) + ", " + std::to_string(static_cast<int>(pos.y)) + ")";
-
-						ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f));
-						if (ImGui::Button("D", { 30, 40 }))
-						{
-							b->destroy();
-						}
-						ImGui::PopStyleColor();
-
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(std::to_string(b->id()).c_str());
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(b->tag().c_str());
-						ImGui::SameLine(); ImGui::Indent(indent * 2);
-						ImGui::Text(position.c_str());
-						ImGui::Unindent(4 * indent);
-						ImGui::PopID();
-					}
-					ImGui::Unindent();
-
-				}
+					drawEntityRows(m_bulletRows, m_entities.getEntities(m_tags.bullet));
 
 				if (ImGui::CollapsingHeader("enemy"))
-				{
-					float indent = 60.0f;
-					ImGui::Indent();
-					for (auto& e : m_entities.getEntities("enemy"))
-					{
-						ImGui::PushID(i++);
-						
-						sf::Color col = e->get<CShape>().circle.getFillColor();
-						sf::Vector2f pos = e->get<CShape>().circle.getPosition();
-						std::string position = "(" + std::to_string(static_cast<int>(pos.x)) + ", " + std::to_string(static_cast<int>(pos.y)) + ")";
-
-						ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f));
-						if (ImGui::Button("D", { 30, 40 }))
-						{
-							e->destroy();
-						}
-						ImGui::PopStyleColor();
-
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(std::to_string(e->id()).c_str());
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(e->tag().c_str());
-						ImGui::SameLine(); ImGui::Indent(indent * 2);
-						ImGui::Text(position.c_str());
-						ImGui::Unindent(4 * indent);
-						ImGui::PopID();
-					}
-					ImGui::Unindent();
-				}
+					drawEntityRows(m_enemyRows, m_entities.getEntities(m_tags.enemy));
 
 				if (ImGui::CollapsingHeader("player"))
-				{
-					//::PushID(0);
-					ImGui::Indent();
-					float indent = 60.0f;
-					sf::Color col = player()->get<CShape>().circle.getFillColor();
-					sf::Vector2f pos = player()->get<CShape>().circle.getPosition();
-					std::string position = "(" + std::to_string(static_cast<int>(pos.x)) + ", " + std::to_string(static_cast<int>(pos.y)) + ")";
-
-					ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f));
-					if (ImGui::Button("D", { 30, 40 }))
-					{
-						player()->destroy();
-					}
-					ImGui::PopStyleColor();
-
-					ImGui::SameLine(); ImGui::Indent(indent);
-					ImGui::Text(std::to_string(player()->id()).c_str());
-					ImGui::SameLine(); ImGui::Indent(indent);
-					ImGui::Text(player()->tag().c_str());
-					ImGui::SameLine(); ImGui::Indent(indent * 2);
-					ImGui::Text(position.c_str());
-					ImGui::Unindent(4 * indent);
-					ImGui::Unindent();
-					//ImGui::PopID();
-				}
+					drawEntityRows(m_playerRows, m_entities.getEntities(m_tags.player));
 
 				if (ImGui::CollapsingHeader("small enemy"))
-				{
-					float indent = 60.0f;
-					ImGui::Indent();
-					for (auto& e : m_entities.getEntities("sEnemy"))
-					{
-						ImGui::PushID(i++);
-
-						sf::Color col = e->get<CShape>().circle.getFillColor();
-						sf::Vector2f pos = e->get<CShape>().circle.getPosition();
-						std::string position = "(" + std::to_string(static_cast<int>(pos.x)) + ", " + std::to_string(static_cast<int>(pos.y)) + ")";
-
-						ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f));
-						if (ImGui::Button("D", { 30, 40 }))
-						{
-							e->destroy();
-						}
-						ImGui::PopStyleColor();
-
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(std::to_string(e->id()).c_str());
-						ImGui::SameLine(); ImGui::Indent(indent);
-						ImGui::Text(e->tag().c_str());
-						ImGui::SameLine(); ImGui::Indent(indent * 2);
-						ImGui::Text(position.c_str());
-						ImGui::Unindent(4 * indent);
-						ImGui::PopID();
-					}
-					ImGui::Unindent();
-				}
+					drawEntityRows(m_sEnemyRows, m_entities.getEntities(m_tags.sEnemy));
 				ImGui::Unindent();
 			} // End of entities dropdown
 			
 			if (ImGui::CollapsingHeader("All Entities"))
+				drawEntityRows(m_allRows, m_entities.getEntities());
+			ImGui::EndTabItem();
+		}
+
+		if (ImGui::BeginTabItem("Profiler"))
+		{
+			size_t frames = m_profiler.frames();
+			size_t sections = m_profiler.sections();
+			auto color = [&](Profiler::Section s) { return ImColor::HSV(static_cast<float>(s) / sections, 0.6f, 0.9f); };
+
+			// Scale to the slowest frame, but never below one 60 Hz frame
+			const float budget = 1000.0f / 60.0f;
+			float scale = budget;
+			for (size_t age = 0; age < frames; ++age)
 			{
-				float indent = 60.0f;
-				ImGui::Indent();
-				for (auto& e : m_entities.getEntities())
-				{
-					ImGui::PushID(i++);
+				float total = 0.0f;
+				for (Profiler::Section s = 0; s < sections; ++s)
+					total += m_profiler.sample(s, age);
+				scale = std::max(scale, total);
+			}
+			ImGui::Text("Last %zu frames, up to %.1f ms", frames, scale);
 
-					sf::Color col = e->get<CShape>().circle.getFillColor();
-					sf::Vector2f pos = e->get<CShape>().circle.getPosition();
-					std::string position = "(" + std::to_string(static_cast<int>(pos.x)) + ", " + std::to_string(static_cast<int>(pos.y)) + ")";
+			// Stacked plot, one column per frame with the newest on the right
+			ImVec2 size(ImGui::GetContentRegionAvail().x, 200.0f);
+			ImVec2 origin = ImGui::GetCursorScreenPos();
+			ImGui::InvisibleButton("timeline", size);
+			ImDrawList* draw = ImGui::GetWindowDrawList();
+			draw->AddRectFilled(origin, { origin.x + size.x, origin.y + size.y }, IM_COL32(20, 20, 20, 255));
 
-					ImGui::PushStyleColor(ImGuiCol_Button, ImVec4(col.r / 255.0f, col.g / 255.0f, col.b / 255.0f, col.a / 255.0f));
-					if (ImGui::Button("D", { 30, 40 }))
-					{
-						e->destroy();
-					}
-					ImGui::PopStyleColor();
-
-					ImGui::SameLine(); ImGui::Indent(indent);
-					ImGui::Text(std::to_string(e->id()).c_str());
-					ImGui::SameLine(); ImGui::Indent(indent);
-					ImGui::Text(e->tag().c_str());
-					ImGui::SameLine(); ImGui::Indent(indent * 2);
-					ImGui::Text(position.c_str());
-					ImGui::Unindent(4 * indent);
-					ImGui::PopID();
+			float column = size.x / Profiler::FRAMES;
+			for (size_t age = 0; age < frames; ++age)
+			{
+				float x = origin.x + size.x - (age + 1) * column;
+				float y = origin.y + size.y;
+				for (Profiler::Section s = 0; s < sections; ++s)
+				{
+					float height = m_profiler.sample(s, age) / scale * size.y;
+					draw->AddRectFilled({ x, y - height }, { x + column, y }, color(s));
+					y -= height;
 				}
-				ImGui::Unindent();
+			}
+			float line = origin.y + size.y - budget / scale * size.y;
+			draw->AddLine({ origin.x, line }, { origin.x + size.x, line }, IM_COL32(255, 255, 255, 100));
 
+			// Breakdown of the frame under the mouse
+			if (ImGui::IsItemHovered())
+			{
+				size_t age = static_cast<size_t>((origin.x + size.x - ImGui::GetIO().MousePos.x) / column);
+				if (age < frames)
+				{
+					ImGui::BeginTooltip();
+					for (Profiler::Section s = 0; s < sections; ++s)
+						ImGui::TextColored(color(s), "%s: %.3f ms", m_profiler.name(s).c_str(), m_profiler.sample(s, age));
+					ImGui::EndTooltip();
+				}
+			}
+
+			if (ImGui::BeginTable("ProfilerStats", 5, ImGuiTableFlags_RowBg))
+			{
+				ImGui::TableSetupColumn("System");
+				ImGui::TableSetupColumn("Last");
+				ImGui::TableSetupColumn("Min");
+				ImGui::TableSetupColumn("Avg");
+				ImGui::TableSetupColumn("p99");
+				ImGui::TableHeadersRow();
+
+				for (Profiler::Section s = 0; s < sections; ++s)
+				{
+					Profiler::Stats stats = m_profiler.stats(s);
+					ImGui::TableNextRow();
+					ImGui::TableNextColumn(); ImGui::TextColored(color(s), "%s", m_profiler.name(s).c_str());
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.last);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.min);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.avg);
+					ImGui::TableNextColumn(); ImGui::Text("%.3f", stats.p99);
+				}
+				ImGui::EndTable();
 			}
 			ImGui::EndTabItem();
 		}
@@ -701,6 +1160,7 @@ void Game::sGUI()
 	
 void Game::sRender()	
 {
+	PROFILE_SCOPE(m_profiler, m_profile.render);
 	// TODO: change code to draw ALL of the entities
 
 	m_window.clear();
@@ -711,40 +1171,33 @@ void Game::sRender()
 		return;
 	}
 
+	m_renderStats = renderStats();
+	m_shapeBatch.clear();
+
 	// Draw bullets
-	for (auto& bullet : m_entities.getEntities("bullet"))
-	{
-		bullet->get<CShape>().circle.setPosition(bullet->get<CTransform>().pos);
-		m_window.draw(bullet->get<CShape>().circle);
-	}
+	m_entities.view<CTransform, CShape>(m_tags.bullet).each([&](Entity e, const CTransform& transform, const CShape& shape) { drawShape(e, transform, shape, false); });
 
 	// Draw enemies
-	for (auto& enemy : m_entities.getEntities("enemy"))
-	{
-		enemy->get<CShape>().circle.setPosition(enemy->get<CTransform>().pos);
-		enemy->get<CShape>().circle.setRotation(sf::degrees(enemy->get<CTransform>().angle));
-		m_window.draw(enemy->get<CShape>().circle);
-	}
+	m_entities.view<CTransform, CShape>(m_tags.enemy).each([&](Entity e, const CTransform& transform, const CShape& shape) { drawShape(e, transform, shape, true); });
 
 	//Draw small enemies
-	for (auto& sEnemy : m_entities.getEntities("sEnemy"))
-	{
-		sEnemy->get<CShape>().circle.setPosition(sEnemy->get<CTransform>().pos);
-		sEnemy->get<CShape>().circle.setRotation(sf::degrees(sEnemy->get<CTransform>().angle));
-		m_window.draw(sEnemy->get<CShape>().circle);
-	}
-
-	// set position of shape based on entity's transform pos
-	player()->get<CShape>().circle.setPosition(player()->get<CTransform>().pos);
-	// Set rotation of player based on entity's transform angle
-	player()->get<CShape>().circle.setRotation(sf::degrees(player()->get<CTransform>().angle));
+	m_entities.view<CTransform, CShape>(m_tags.sEnemy).each([&](Entity e, const CTransform& transform, const CShape& shape) { drawShape(e, transform, shape, true); });
 
 	//draw player
-	m_window.draw(player()->get<CShape>().circle);
+	drawShape(player(), player().get<CTransform>(), player().get<CShape>(), true);
+
+	// Submit every batched shape at once
+	if (m_systems.batching)
+	{
+		m_shapeBatch.draw(m_window);
+		m_renderStats.drawCalls++;
+		m_renderStats.vertices += m_shapeBatch.vertexCount();
+	}
 
 	//Draw score
 	m_text.setString("Score:  " + std::to_string(m_score));
 	m_window.draw(m_text);
+	m_renderStats.drawCalls++;
 
 	//Draw high score
 	m_high_score_text.setString("High  Score:  " + std::to_string(m_high_score));
@@ -752,6 +1205,7 @@ void Game::sRender()
 	m_high_score_text.setOrigin({ textBounds.size.x, 0});
 	m_high_score_text.setPosition({ static_cast<float>(m_window.getSize().x)- 10.0f, 0 });
 	m_window.draw(m_high_score_text);
+	m_renderStats.drawCalls++;
 
 	// Draw the ui last
 	ImGui::SFML::Render(m_window);
@@ -760,9 +1214,52 @@ void Game::sRender()
 
 }
 
+// Draws an entity's shape at its transform, either into the frame's batch or on its own
+void Game::drawShape(Entity entity, const CTransform& transform, const CShape& shape, bool rotate)
+{
+	// Draw between the last two ticks, by how far the clock is into the next one
+	Vec2f pos = transform.prevPos + (transform.pos - transform.prevPos) * m_interpolation;
+	float angle = rotate ? transform.prevAngle + (transform.angle - transform.prevAngle) * m_interpolation : 0.0f;
+
+	// Entities with a lifespan fade out with the time they have left
+	uint8_t alpha = 255;
+	if (entity.has<CLifespan>())
+	{
+		auto& lifespan = entity.get<CLifespan>();
+		float left = lifespan.expires - m_lifespanTick - (m_systems.lifespan ? m_interpolation : 0.0f);
+		alpha = static_cast<uint8_t>(std::clamp(left / lifespan.lifespan, 0.0f, 1.0f) * 255.0f);
+	}
+
+	if (m_systems.batching)
+	{
+		m_shapeBatch.add(shape, pos, angle, alpha);
+		return;
+	}
+
+	// One draw per shape through SFML, the scratch circle is set up from the component each time
+	sf::Color fill = shape.fillColor(), outline = shape.outlineColor();
+	fill.a = static_cast<uint8_t>(fill.a * alpha / 255);
+	outline.a = static_cast<uint8_t>(outline.a * alpha / 255);
+
+	m_circle.setRadius(shape.radius);
+	m_circle.setPointCount(shape.points);
+	m_circle.setOrigin({ shape.radius, shape.radius });
+	m_circle.setFillColor(fill);
+	m_circle.setOutlineColor(outline);
+	m_circle.setOutlineThickness(shape.thickness);
+	m_circle.setPosition(pos);
+	m_circle.setRotation(sf::degrees(angle));
+	m_window.draw(m_circle);
+
+	// sf::CircleShape draws its fill and its outline separately
+	m_renderStats.drawCalls += shape.thickness != 0.0f ? 2 : 1;
+	m_renderStats.vertices += (shape.points + 2) + (shape.thickness != 0.0f ? 2 * shape.points + 2 : 0);
+}
+
 // Handle user input here
 void Game::sUserInput()
 {
+	PROFILE_SCOPE(m_profiler, m_profile.input);
 	// set player's input component variables
 
 	 // Handle Events
@@ -782,32 +1279,40 @@ void Game::sUserInput()
 			switch (keyPressed->scancode)
 			{
 			case sf::Keyboard::Scan::W:
-				std::cout << "W Key Pressed\n";
-				player()->get<CInput>().up = true;
+				LOG_DEBUG("W Key Pressed");
+				player().get<CInput>().up = true;
 				break;
 			case sf::Keyboard::Scan::S:
-				std::cout << "S Key Pressed\n";
-				player()->get<CInput>().down = true;
+				LOG_DEBUG("S Key Pressed");
+				player().get<CInput>().down = true;
 				break;
 			case sf::Keyboard::Scan::A:
-				std::cout << "A Key Pressed\n";
-				player()->get<CInput>().left = true;
+				LOG_DEBUG("A Key Pressed");
+				player().get<CInput>().left = true;
 				break;
 			case sf::Keyboard::Scan::D:
-				std::cout << "D Key Pressed\n";
-				player()->get<CInput>().right = true;
+				LOG_DEBUG("D Key Pressed");
+				player().get<CInput>().right = true;
 				break;
 			case sf::Keyboard::Scan::P:
-				std::cout << "P Key Pressed, Pausing/Resuming!\n";
+				LOG_DEBUG("P Key Pressed, Pausing/Resuming!");
 				m_paused = !m_paused;
 				break;
 			case sf::Keyboard::Scan::Escape:
-				std::cout << "Exiting game!\n";
+				LOG_INFO("Exiting game!");
 				m_running = false;
 				break;
 			case sf::Keyboard::Scan::G:
-				std::cout << "Toggling GUI!\n";
+				LOG_DEBUG("Toggling GUI!");
 				m_systems.gui = !m_systems.gui;
+				break;
+			case sf::Keyboard::Scan::T:
+				// Start or stop streaming the profiler timings to a Chrome trace file
+				if (Trace::active())
+					Trace::stop();
+				else
+					Trace::start("trace.json");
+				break;
 			default:
 					break;
 			}
@@ -819,20 +1324,20 @@ void Game::sUserInput()
 			switch (keyReleased->scancode)
 			{
 			case sf::Keyboard::Scan::W:
-				std::cout << "W Key released\n";
-				player()->get<CInput>().up = false;
+				LOG_DEBUG("W Key released");
+				player().get<CInput>().up = false;
 				break;
 			case sf::Keyboard::Scan::S:
-				std::cout << "S Key Released\n";
-				player()->get<CInput>().down = false;
+				LOG_DEBUG("S Key Released");
+				player().get<CInput>().down = false;
 				break;
 			case sf::Keyboard::Scan::A:
-				std::cout << "A Key Released\n";
-				player()->get<CInput>().left = false;
+				LOG_DEBUG("A Key Released");
+				player().get<CInput>().left = false;
 				break;
 			case sf::Keyboard::Scan::D:
-				std::cout << "D Key Released\n";
-				player()->get<CInput>().right = false;
+				LOG_DEBUG("D Key Released");
+				player().get<CInput>().right = false;
 				break;
 			default:
 				break;
@@ -842,21 +1347,21 @@ void Game::sUserInput()
 		//Mouse buttons
 		else if (const auto* mouseButtonPressed = event->getIf<sf::Event::MouseButtonPressed>())
 		{
-			// Ignore mouse events if ImGui is being clicked
-			if (ImGui::GetIO().WantCaptureMouse) { continue; }
+			// Ignore mouse events if ImGui is being clicked, and shots while paused
+			if (ImGui::GetIO().WantCaptureMouse || m_paused) { continue; }
 
 			// Spawn bullet if left click
 			if (mouseButtonPressed->button == sf::Mouse::Button::Left)
 			{
-				std::cout << "Left mouse button was pressed at position (" << mouseButtonPressed->position.x << ", " << mouseButtonPressed->position.y << ")\n";
-				spawnBullet(player(), sf::Vector2f(mouseButtonPressed->position));
+				LOG_DEBUG("Left mouse button was pressed at position (%d, %d)", mouseButtonPressed->position.x, mouseButtonPressed->position.y);
+				m_pendingInput.push_back({ InputEvent::Shoot, Vec2f(mouseButtonPressed->position.x, mouseButtonPressed->position.y) });
 			}
 
 			// Spawn special weapon if right click
 			else if (mouseButtonPressed->button == sf::Mouse::Button::Right)
 			{
-				std::cout << "Right mouse button was pressed";
-				spawnSpecialWeapon(player());
+				LOG_DEBUG("Right mouse button was pressed");
+				m_pendingInput.push_back({ InputEvent::Special });
 			}
 		}
 
@@ -7,14 +7,38 @@
 struct PlayerConfig { int SR, CR, FR, FG, FB, OR, OG, OB, OT, V; float S; };
 struct EnemyConfig { int SR, CR, OR, OG, OB, OT, VMIN, VMAX, L, SI; float SMIN, SMAX; };
 struct BulletConfig { int SR, CR, FR, FG, FB, OR, OG, OB, OT, V, L; float S; };
-struct systems { bool movement{ true }, lifespan{ true }, gui{ true }, collision{ true }, spawning{ true }, rendering{ true }; };
+struct systems { bool movement{ true }, lifespan{ true }, gui{ true }, collision{ true }, spawning{ true }, rendering{ true }, batching{ true }; };
+struct renderStats { size_t drawCalls{ 0 }, vertices{ 0 }; };
+struct collisionStats { size_t pairTests{ 0 }, hits{ 0 }; };	// narrowphase checks and overlaps in the last tick
+enum class CollisionBackend { BruteForce, Grid, SweepAndPrune };
 
 #include "EntityManager.hpp"
 
+struct tags { TagId player{}, enemy{}, sEnemy{}, bullet{}; };
+struct bulletHit { uint32_t bullet, target; bool small; float time; };	// overlap found by sCollision, indices into the tag lists, time of contact 0..1 within the tick
+#include "SpatialGrid.hpp"
+#include "SweepAndPrune.hpp"
+#include "ShapeBatch.hpp"
+#include "Movement.h"
+#include "Narrowphase.h"
+struct collisionTask { std::vector<bulletHit> hits; Narrowphase::Circles candidates; std::vector<uint64_t> mask; };	// one per sCollision task, reused every tick
+#include "JobSystem.h"
+#include "Replay.h"
+#include "Random.h"
+#include "Profiler.hpp"
+#include "ExpiryQueue.hpp"
+
+struct entityRow { Entity entity; TagId tag; ImVec4 color; char id[24]; char position[32]; };	// one line of the Entities tab, formatted ahead of time
+struct entityRows { std::vector<entityRow> rows; float refreshed{ -1000.0f }; };	// seconds on m_guiClock
+struct profileSections { Profiler::Section entities{}, spawner{}, movement{}, collision{}, lifespan{}, input{}, gui{}, render{}; };
+
 
 class Game
 {
+	friend class Benchmark;		// bench.cpp drives the systems directly
+
 	sf::RenderWindow		m_window;		// Window we will draw to
+	sf::Vector2u			m_arenaSize;	// Size of the play field, read from config
 	EntityManager			m_entities;		// vector of entities to maintian
 	sf::Font				m_font;			// font we will use to draw
 	sf::Text				m_text;			// Score text drawn to screen
@@ -23,38 +47,86 @@ class Game
 	EnemyConfig				m_enemyConfig;
 	BulletConfig			m_bulletConfig;
 	systems					m_systems;
+	tags					m_tags;			// registered in init, use these instead of tag strings
+	Entity					m_player;		// cached handle, see player()
+	CollisionBackend		m_collisionBackend = CollisionBackend::Grid;
+	Movement::Isa			m_movementIsa = Movement::integrator();	// instruction set used by sMovement
+	Narrowphase::Isa		m_narrowphaseIsa = Movement::detect();	// and by the bullet tests in sCollision
+	SpatialGrid				m_enemyGrid;	// broadphase for "enemy", rebuilt each frame
+	SpatialGrid				m_sEnemyGrid;	// broadphase for "sEnemy", rebuilt each frame
+	SweepAndPrune			m_enemySap;		// the same for the sweep-and-prune backend,
+	SweepAndPrune			m_sEnemySap;	// these keep their order from frame to frame
+	Narrowphase::Circles	m_enemyCircles;		// every enemy packed for the brute force backend,
+	Narrowphase::Circles	m_sEnemyCircles;	// the other backends pack each bullet's candidates
+	collisionStats			m_collisionStats;
+	JobSystem				m_jobs;			// worker threads the systems split their entity lists over
+	std::vector<collisionTask>	m_collisionTasks;	// see sCollision
+	EntityVec				m_collisionBullets, m_collisionEnemies, m_collisionSEnemies;	// what sCollision tests this tick, gathered from views
 	sf::Clock				m_deltaClock;
+	float					m_tickRate = 60.0f;		// simulation ticks per second
+	int						m_maxTicksPerFrame = 5;	// catch-up limit, beyond it the game slows down
+	int						m_ticksLastFrame = 0;
+	float					m_accumulator = 0.0f;	// frame time not simulated yet, in seconds
+	float					m_interpolation = 0.0f;	// 0..1 between the previous and current tick, used by sRender
+	ShapeBatch				m_shapeBatch;	// all entity shapes for the frame, see sRender
+	sf::CircleShape			m_circle;		// scratch shape for drawing without the batch
+	renderStats				m_renderStats;	// draw calls and vertices submitted last frame
 	long int				m_score = 0;
 	long int				m_high_score;
-	int						m_currentFrame = 0;
+	int						m_currentFrame = 0;	// counts simulation ticks
+	int						m_lifespanTick = 0;	// ticks the Lifespan system has run, lifespans count down on this
+	uint64_t				m_seed = 0;			// Random seed the game was started with
+	Random::Generator		m_spawnRng;			// Random::Spawning stream, used by the spawn functions
+	std::vector<InputEvent>	m_pendingInput;		// applied at the start of the next tick
+	Replay::Writer			m_recorder;
+	Profiler				m_profiler;			// per system frame times, shown in the Profiler tab
+	profileSections			m_profile;			// registered in init
+	entityRows				m_bulletRows, m_enemyRows, m_playerRows, m_sEnemyRows, m_allRows;	// Entities tab, see drawEntityRows
+	float					m_entityRefresh = 0.25f;	// seconds between reformatting those
+	sf::Clock				m_guiClock;
+	ExpiryQueue				m_expiry;			// every CLifespan by the tick it runs out, see sLifespan
 	int						m_lastEnemySpawnTime = 0;
 	bool					m_paused = false;	// whether we update game logic
 	bool					m_running = true;	// whether game is running
+	bool					m_headless = false;	// no window, ImGui or rendering
 
 	void init(const std::string& path);	// Initialize GameState with a config file
 	//void setPaused(bool paused);		//	pause the game
+	void update();						// advance the game logic by one frame
+	void applyInput();					// spawn whatever the player asked for since the last tick
+	void seed(uint64_t value);			// reseed Random and every stream the game owns
 
 	void sMovement();
 	void sUserInput();
 	void sLifespan();
 	void sRender();
+	void drawShape(Entity entity, const CTransform& transform, const CShape& shape, bool rotate);
 	void sGUI();
+	void drawEntityRows(entityRows& list, const EntityVec& entities);
 	void sEnemySpawner();
 	void sCollision();
 
 	void spawnPlayer();
 	void spawnEnemy();
-	void spawnSmallEnemies(std::shared_ptr<Entity> entity);
-	void spawnBullet(std::shared_ptr<Entity> entity, const Vec2f& mousePos);
-	void spawnSpecialWeapon(std::shared_ptr<Entity> entity);
+	void spawnSmallEnemies(Entity entity);
+	void spawnBullet(Entity entity, const Vec2f& mousePos);
+	void spawnSpecialWeapon(Entity entity);
+	void addLifespan(Entity entity, int ticks);
 
-	std::shared_ptr<Entity> player();
-	bool checkCollision(std::shared_ptr<Entity> entity1, std::shared_ptr<Entity> entity2);
+	Entity player();
+	bool checkCollision(Entity entity1, Entity entity2);
+	bool checkSweptCollision(const Vec2f& start, const Vec2f& path, float radius, Entity other, float& time);
+	template <typename F>
+	bool forEachCandidate(const SpatialGrid& grid, const SweepAndPrune& sap, const EntityVec& entities, const Vec2f& pos, float radius, F&& f);
 
 public:
-	Game(const std::string& config);	//constructor which takes config
+	Game(const std::string& config, bool headless = false);	//constructor which takes config
 
 	void run();
+	double step(int frames);	// run the simulation systems only, returns frames per second
+
+	void record(const std::string& path);	// write the seed and every tick's input to a replay file
+	void replay(const std::string& path);	// play a replay file back headless, as fast as possible
 };
 
 
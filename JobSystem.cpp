@@ -0,0 +1,122 @@
+#include "JobSystem.h"
+#include "Trace.h"
+#include <string>
+
+JobSystem::~JobSystem()
+{
+	stop();
+}
+
+void JobSystem::start(size_t workers, size_t threshold)
+{
+	stop();
+
+	if (workers == 0)
+	{
+		unsigned int cores = std::thread::hardware_concurrency();
+		workers = cores > 1 ? cores - 1 : 0;
+	}
+
+	m_threshold = threshold;
+	m_stop = false;
+	m_queues.clear();
+	for (size_t i = 0; i < workers; ++i)
+		m_queues.push_back(std::make_unique<Queue>());
+
+	for (size_t i = 0; i < workers; ++i)
+		m_workers.emplace_back(&JobSystem::workerLoop, this, i);
+}
+
+void JobSystem::stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_sleepMutex);
+		m_stop = true;
+	}
+	m_wake.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+
+	m_workers.clear();
+}
+
+void JobSystem::push(size_t queue, const Task& task)
+{
+	std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+	m_queues[queue]->tasks.push_back(task);
+
+	// Counting under the sleep lock makes sure a worker that just found nothing
+	// can't go to sleep without seeing this task
+	std::lock_guard<std::mutex> sleepLock(m_sleepMutex);
+	m_queued.fetch_add(1, std::memory_order_release);
+}
+
+// Newest task from the worker's own queue
+bool JobSystem::pop(size_t queue, Task& task)
+{
+	std::lock_guard<std::mutex> lock(m_queues[queue]->mutex);
+	if (m_queues[queue]->tasks.empty())
+		return false;
+
+	task = m_queues[queue]->tasks.back();
+	m_queues[queue]->tasks.pop_back();
+	m_queued.fetch_sub(1, std::memory_order_relaxed);
+	return true;
+}
+
+// Oldest task from any other queue, starting with the thief's neighbour
+bool JobSystem::steal(size_t thief, Task& task)
+{
+	for (size_t i = 1; i <= m_queues.size(); ++i)
+	{
+		size_t victim = (thief + i) % m_queues.size();
+		if (victim == thief)
+			continue;
+
+		std::lock_guard<std::mutex> lock(m_queues[victim]->mutex);
+		if (m_queues[victim]->tasks.empty())
+			continue;
+
+		task = m_queues[victim]->tasks.front();
+		m_queues[victim]->tasks.pop_front();
+		m_queued.fetch_sub(1, std::memory_order_relaxed);
+		return true;
+	}
+
+	return false;
+}
+
+void JobSystem::execute(Task& task)
+{
+	if (Trace::active())
+	{
+		auto begin = Trace::Clock::now();
+		task.run(task.context, task.begin, task.end);
+		Trace::complete("Job", begin, Trace::Clock::now());
+	}
+	else
+		task.run(task.context, task.begin, task.end);
+
+	task.pending->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::workerLoop(size_t index)
+{
+	Trace::nameThread("Worker " + std::to_string(index + 1));
+
+	Task task;
+	while (true)
+	{
+		if (pop(index, task) || steal(index, task))
+		{
+			execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_sleepMutex);
+		m_wake.wait(lock, [this] { return m_stop || m_queued.load(std::memory_order_acquire) > 0; });
+		if (m_stop)
+			return;
+	}
+}
@@ -0,0 +1,125 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Small work-stealing thread pool used by the systems to split entity lists across cores.
+// Every worker has its own queue: it takes work from the back of it, and when that is
+// empty it steals from the front of the other queues. The thread that calls parallelFor
+// helps out until its range is finished, so a pool with no workers just runs serially.
+class JobSystem
+{
+	struct Task
+	{
+		void				(*run)(void* context, size_t begin, size_t end) = nullptr;
+		void*				context = nullptr;
+		size_t				begin = 0;
+		size_t				end = 0;
+		std::atomic<size_t>* pending = nullptr;
+	};
+
+	struct Queue
+	{
+		std::mutex			mutex;
+		std::deque<Task>	tasks;
+	};
+
+	std::vector<std::thread>			m_workers;
+	std::vector<std::unique_ptr<Queue>>	m_queues;		// one per worker
+	std::mutex							m_sleepMutex;
+	std::condition_variable				m_wake;
+	std::atomic<size_t>					m_queued{ 0 };	// tasks sitting in any queue
+	bool								m_stop{ false };
+	size_t								m_threshold{ 2048 };
+	size_t								m_nextQueue{ 0 };
+
+	void workerLoop(size_t index);
+	bool pop(size_t queue, Task& task);
+	bool steal(size_t thief, Task& task);
+	void push(size_t queue, const Task& task);
+	void execute(Task& task);
+
+public:
+
+	JobSystem() = default;
+	~JobSystem();
+
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	// Starts the worker threads, 0 means one less than the number of cores
+	// since the main thread works too. Ranges smaller than threshold run serially.
+	void start(size_t workers, size_t threshold);
+	void stop();
+
+	size_t workerCount() const { return m_workers.size(); }
+	size_t threshold() const { return m_threshold; }
+
+	// Number of items per task when a range of count items is split up,
+	// the range is never split when it is below the threshold
+	size_t grain(size_t count) const
+	{
+		if (m_workers.empty() || count < m_threshold)
+			return std::max<size_t>(count, 1);
+
+		// A few tasks per thread so a slow one can be balanced by stealing
+		size_t tasks = (m_workers.size() + 1) * 4;
+		return std::max<size_t>((count + tasks - 1) / tasks, 64);
+	}
+
+	// Calls fn(begin, end) over [0, count) in chunks of grain(count), spread over the
+	// workers and the calling thread. Returns once every chunk has run.
+	template <typename F>
+	void parallelFor(size_t count, F&& fn)
+	{
+		if (count == 0)
+			return;
+
+		size_t step = grain(count);
+		if (step >= count)
+		{
+			fn(size_t(0), count);
+			return;
+		}
+
+		using Fn = std::remove_reference_t<F>;
+		std::atomic<size_t> pending{ (count + step - 1) / step };
+
+		Task task;
+		task.run = [](void* context, size_t begin, size_t end) { (*static_cast<Fn*>(context))(begin, end); };
+		task.context = const_cast<void*>(static_cast<const void*>(&fn));
+		task.pending = &pending;
+
+		// Keep the first chunk for this thread, deal the rest out to the workers
+		for (size_t begin = step; begin < count; begin += step)
+		{
+			task.begin = begin;
+			task.end = std::min(begin + step, count);
+			push(m_nextQueue++ % m_queues.size(), task);
+		}
+		m_wake.notify_all();
+
+		task.begin = 0;
+		task.end = step;
+		execute(task);
+
+		// Help with whatever is left, then wait for the chunks still running elsewhere
+		while (pending.load(std::memory_order_acquire) > 0)
+		{
+			if (steal(m_queues.size(), task))
+				execute(task);
+			else
+				std::this_thread::yield();
+		}
+	}
+};
+
+#endif
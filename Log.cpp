@@ -0,0 +1,204 @@
+#include "Log.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace Log
+{
+	static constexpr size_t CAPACITY = 1024;	// messages, power of two
+
+	// Bounded multi-producer ring: a slot is free for position p when its sequence is p,
+	// and holds a message for the writer when it is p + 1
+	struct Slot
+	{
+		std::atomic<size_t>	sequence;
+		detail::Message		message;
+	};
+
+	static Slot						s_ring[CAPACITY];
+	static std::atomic<size_t>		s_head{ 0 };		// next position to claim
+	static size_t					s_tail{ 0 };		// next position to print, writer only
+	static std::atomic<size_t>		s_dropped{ 0 };
+	static std::atomic<bool>		s_running{ false };
+	static std::thread				s_writer;
+	static std::mutex				s_mutex;
+	static std::condition_variable	s_wake;
+	static bool						s_stopping{ false };
+
+	const char* name(Level l)
+	{
+		switch (l)
+		{
+		case Debug: return "debug";
+		case Info: return "info";
+		case Warning: return "warning";
+		case Error: return "error";
+		default: return "off";
+		}
+	}
+
+	bool parse(const char* text, Level& l)
+	{
+		for (Level candidate : { Debug, Info, Warning, Error, Off })
+		{
+			if (std::strcmp(text, name(candidate)) == 0)
+			{
+				l = candidate;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Info lines are printed as they are, the others get their level in front
+	static void format(const detail::Message& message, std::string& out)
+	{
+		char line[256];
+		const char* text = line;
+		if (message.format)
+			message.print(message, line, sizeof(line));
+		else
+			text = reinterpret_cast<const char*>(message.data);
+
+		if (message.level != Info)
+			out.append(name(message.level)).append(": ");
+		out.append(text).append("\n");
+	}
+
+	// Prints everything published so far, returns false if there was nothing
+	static bool drain(std::string& out)
+	{
+		out.clear();
+		while (true)
+		{
+			Slot& slot = s_ring[s_tail & (CAPACITY - 1)];
+			if (slot.sequence.load(std::memory_order_acquire) != s_tail + 1)
+				break;
+
+			format(slot.message, out);
+			slot.sequence.store(s_tail + CAPACITY, std::memory_order_release);
+			s_tail++;
+		}
+
+		size_t dropped = s_dropped.exchange(0, std::memory_order_relaxed);
+		if (dropped > 0)
+			out.append("warning: ").append(std::to_string(dropped)).append(" log messages dropped\n");
+
+		if (out.empty())
+			return false;
+
+		std::fwrite(out.data(), 1, out.size(), stdout);
+		std::fflush(stdout);
+		return true;
+	}
+
+	// Nothing wakes the writer, it looks at the ring every few milliseconds, so queueing
+	// a message never makes a system call
+	static void writerLoop()
+	{
+		std::string out;
+		while (true)
+		{
+			bool stopping;
+			{
+				std::unique_lock<std::mutex> lock(s_mutex);
+				s_wake.wait_for(lock, std::chrono::milliseconds(10), [] { return s_stopping; });
+				stopping = s_stopping;
+			}
+
+			drain(out);
+			if (stopping)
+				break;
+		}
+	}
+
+	void start()
+	{
+		if (s_writer.joinable())
+			return;
+
+		for (size_t i = 0; i < CAPACITY; ++i)
+			s_ring[i].sequence.store(i, std::memory_order_relaxed);
+		s_head.store(0, std::memory_order_relaxed);
+		s_tail = 0;
+		s_stopping = false;
+
+		s_writer = std::thread(writerLoop);
+		s_running.store(true, std::memory_order_release);
+	}
+
+	void stop()
+	{
+		if (!s_writer.joinable())
+			return;
+
+		// New messages are printed directly from here on, the writer finishes the queued ones.
+		// A thread that saw running() just before this may still be publishing, wait for it
+		s_running.store(false);
+		while (detail::producers.load() != 0)
+			std::this_thread::yield();
+		{
+			std::lock_guard<std::mutex> lock(s_mutex);
+			s_stopping = true;
+		}
+		s_wake.notify_one();
+		s_writer.join();
+	}
+
+	namespace detail
+	{
+		bool running()
+		{
+			return s_running.load();
+		}
+
+		Message* claim()
+		{
+			size_t position = s_head.load(std::memory_order_relaxed);
+			while (true)
+			{
+				Slot& slot = s_ring[position & (CAPACITY - 1)];
+				size_t sequence = slot.sequence.load(std::memory_order_acquire);
+				auto diff = static_cast<std::ptrdiff_t>(sequence - position);
+
+				if (diff == 0)
+				{
+					if (s_head.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						slot.message.position = position;
+						return &slot.message;
+					}
+				}
+				else if (diff < 0)
+				{
+					// The writer hasn't got to this slot since the last lap
+					s_dropped.fetch_add(1, std::memory_order_relaxed);
+					return nullptr;
+				}
+				else
+				{
+					// Another thread claimed it first
+					position = s_head.load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		void publish(Message& message)
+		{
+			s_ring[message.position & (CAPACITY - 1)].sequence.store(message.position + 1, std::memory_order_release);
+		}
+
+		void print(const Message& message)
+		{
+			std::string out;
+			format(message, out);
+			std::fwrite(out.data(), 1, out.size(), stdout);
+			std::fflush(stdout);
+		}
+	}
+
+	// Prints what is still queued if the program ends without calling stop()
+	static struct StopAtExit { ~StopAtExit() { stop(); } } s_stopAtExit;
+}
@@ -0,0 +1,129 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <tuple>
+#include <type_traits>
+
+// Build with LOG_MIN_LEVEL=1 (Info), 2 (Warning) or 3 (Error) to compile the levels below it out
+#ifndef LOG_MIN_LEVEL
+#define LOG_MIN_LEVEL 0
+#endif
+
+// Leveled logging that keeps console output off the game loop.
+// A message is queued in a lock-free ring and printed by a background thread, one line each.
+// Messages whose arguments are all numbers are queued unformatted, so the caller only copies
+// the arguments; anything else (strings) is formatted right away into the queued message.
+// The format is printf style and has to be a string literal, since it is read later.
+//
+// Until start() is called, and after stop(), messages are printed directly instead.
+// When the ring is full new messages are dropped, the writer reports how many.
+namespace Log
+{
+	enum Level : uint8_t { Debug, Info, Warning, Error, Off };
+
+	// Messages below this are skipped at runtime, the LOG macros also skip anything below LOG_MIN_LEVEL
+	inline std::atomic<Level> level{ Info };
+
+	inline bool enabled(Level l)
+	{
+		return l >= level.load(std::memory_order_relaxed);
+	}
+
+	const char* name(Level l);
+
+	// "debug", "info", "warning", "error" or "off", false if it's none of them
+	bool parse(const char* text, Level& l);
+
+	// Starts the writer thread, stop() prints whatever is still queued and ends it
+	void start();
+	void stop();
+
+	namespace detail
+	{
+		struct Message
+		{
+			Level		level;
+			const char*	format;		// null if data already holds the line
+			void		(*print)(const Message&, char* out, size_t size);
+			size_t		position;	// in the ring
+			alignas(8) unsigned char	data[200];	// the arguments, or the formatted line
+		};
+
+		bool running();
+
+		// Threads between deciding to queue a message and publishing it. stop() waits for
+		// them to finish before the last drain, so nothing queued late is lost
+		inline std::atomic<int> producers{ 0 };
+
+		Message* claim();			// null if the ring is full
+		void publish(Message& message);
+		void print(const Message& message);		// on the calling thread
+
+		template <typename... Args>
+		void printArgs(const Message& message, char* out, size_t size)
+		{
+			if constexpr (sizeof...(Args) == 0)
+			{
+				std::snprintf(out, size, "%s", message.format);
+			}
+			else
+			{
+				const auto& args = *std::launder(reinterpret_cast<const std::tuple<Args...>*>(message.data));
+				std::apply([&](const Args&... a) { std::snprintf(out, size, message.format, a...); }, args);
+			}
+		}
+
+		template <typename... Args>
+		void fill(Message& message, Level l, const char* format, const Args&... args)
+		{
+			message.level = l;
+			if constexpr (((std::is_arithmetic_v<Args> || std::is_enum_v<Args>) && ...) && sizeof(std::tuple<Args...>) <= sizeof(Message::data))
+			{
+				message.format = format;
+				message.print = &printArgs<Args...>;
+				new (message.data) std::tuple<Args...>(args...);
+			}
+			else
+			{
+				message.format = nullptr;
+				std::snprintf(reinterpret_cast<char*>(message.data), sizeof(message.data), format, args...);
+			}
+		}
+	}
+
+	template <typename... Args>
+	void write(Level l, const char* format, const Args&... args)
+	{
+		// Counted before running() is checked, pairs with stop() which clears running first
+		detail::producers.fetch_add(1);
+		if (!detail::running())
+		{
+			detail::producers.fetch_sub(1);
+			detail::Message message;
+			detail::fill(message, l, format, args...);
+			detail::print(message);
+			return;
+		}
+
+		if (detail::Message* message = detail::claim())
+		{
+			detail::fill(*message, l, format, args...);
+			detail::publish(*message);
+		}
+		detail::producers.fetch_sub(1, std::memory_order_release);
+	}
+}
+
+#define LOG(l, ...) do { if constexpr (Log::l >= LOG_MIN_LEVEL) { if (Log::enabled(Log::l)) Log::write(Log::l, __VA_ARGS__); } } while (0)
+#define LOG_DEBUG(...) LOG(Debug, __VA_ARGS__)
+#define LOG_INFO(...) LOG(Info, __VA_ARGS__)
+#define LOG_WARNING(...) LOG(Warning, __VA_ARGS__)
+#define LOG_ERROR(...) LOG(Error, __VA_ARGS__)
+
+#endif
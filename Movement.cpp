@@ -0,0 +1,188 @@
+#include "Movement.h"
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define MOVEMENT_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+namespace Movement
+{
+	// One entity at a time, also handles the leftovers of the vector versions
+	static void integrateScalar(CTransform* transforms, const CCollision* collisions, const Entity* entities, size_t count, const Params& params)
+	{
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto& transform = transforms[entities[i].index()];
+			transform.pos += transform.velocity;
+			transform.angle += params.spin;
+
+			if (params.bounds)
+			{
+				float radius = collisions[entities[i].index()].radius;
+
+				// Bounce off walls
+				if (transform.pos.x + radius >= params.bounds->x || transform.pos.x - radius <= 0)
+					transform.velocity.x *= -1;
+
+				if (transform.pos.y + radius >= params.bounds->y || transform.pos.y - radius <= 0)
+					transform.velocity.y *= -1;
+			}
+		}
+	}
+
+#ifdef MOVEMENT_X86
+
+	// pos.x, pos.y, velocity.x, velocity.y are adjacent, so one unaligned load gets all four
+	static float* motion(CTransform* transforms, const Entity& entity)
+	{
+		return &transforms[entity.index()].pos.x;
+	}
+
+	static void integrateSSE2(CTransform* transforms, const CCollision* collisions, const Entity* entities, size_t count, const Params& params)
+	{
+		const __m128 sign = _mm_set1_ps(-0.0f);
+		const __m128 zero = _mm_setzero_ps();
+		__m128 width = zero, height = zero;
+		if (params.bounds)
+		{
+			width = _mm_set1_ps(static_cast<float>(params.bounds->x));
+			height = _mm_set1_ps(static_cast<float>(params.bounds->y));
+		}
+
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4)
+		{
+			float* m[4] = { motion(transforms, entities[i]), motion(transforms, entities[i + 1]), motion(transforms, entities[i + 2]), motion(transforms, entities[i + 3]) };
+
+			// Rows are entities, after the transpose they are px, py, vx, vy
+			__m128 px = _mm_loadu_ps(m[0]), py = _mm_loadu_ps(m[1]), vx = _mm_loadu_ps(m[2]), vy = _mm_loadu_ps(m[3]);
+			_MM_TRANSPOSE4_PS(px, py, vx, vy);
+
+			px = _mm_add_ps(px, vx);
+			py = _mm_add_ps(py, vy);
+
+			if (params.bounds)
+			{
+				__m128 r = _mm_setr_ps(collisions[entities[i].index()].radius, collisions[entities[i + 1].index()].radius,
+					collisions[entities[i + 2].index()].radius, collisions[entities[i + 3].index()].radius);
+
+				// Flip the sign of the velocity wherever the entity touches a wall
+				__m128 hitX = _mm_or_ps(_mm_cmpge_ps(_mm_add_ps(px, r), width), _mm_cmple_ps(_mm_sub_ps(px, r), zero));
+				__m128 hitY = _mm_or_ps(_mm_cmpge_ps(_mm_add_ps(py, r), height), _mm_cmple_ps(_mm_sub_ps(py, r), zero));
+				vx = _mm_xor_ps(vx, _mm_and_ps(hitX, sign));
+				vy = _mm_xor_ps(vy, _mm_and_ps(hitY, sign));
+			}
+
+			_MM_TRANSPOSE4_PS(px, py, vx, vy);
+			_mm_storeu_ps(m[0], px);
+			_mm_storeu_ps(m[1], py);
+			_mm_storeu_ps(m[2], vx);
+			_mm_storeu_ps(m[3], vy);
+
+			for (int k = 0; k < 4; ++k)
+				transforms[entities[i + k].index()].angle += params.spin;
+		}
+
+		integrateScalar(transforms, collisions, entities + i, count - i, params);
+	}
+
+	static bool cpuHasAVX2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+			return false;
+
+		// The OS has to save the YMM registers (OSXSAVE + XCR0 bits 1 and 2)
+		__cpuid(info, 1);
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		if (!osxsave || (_xgetbv(0) & 6) != 6)
+			return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+#else
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+#endif // MOVEMENT_X86
+
+	bool supported(Isa isa)
+	{
+		switch (isa)
+		{
+#ifdef MOVEMENT_X86
+		case Isa::AVX2:
+		{
+			static const bool avx2 = cpuHasAVX2();
+			return avx2;
+		}
+		case Isa::SSE2:
+			return true;	// part of x86-64
+#endif
+		case Isa::Scalar:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	Isa detect()
+	{
+		if (supported(Isa::AVX2))
+			return Isa::AVX2;
+		if (supported(Isa::SSE2))
+			return Isa::SSE2;
+		return Isa::Scalar;
+	}
+
+	Isa integrator()
+	{
+		return supported(Isa::SSE2) ? Isa::SSE2 : Isa::Scalar;
+	}
+
+	const char* name(Isa isa)
+	{
+		switch (isa)
+		{
+		case Isa::AVX2: return "AVX2";
+		case Isa::SSE2: return "SSE2";
+		default: return "Scalar";
+		}
+	}
+
+	void integrate(EntityManager& manager, const Entity* entities, size_t count, const Params& params, Isa isa)
+	{
+		CTransform* transforms = manager.components<CTransform>();
+		const CCollision* collisions = manager.components<CCollision>();
+
+		// Remember where everything was for render interpolation
+		for (size_t i = 0; i < count; ++i)
+		{
+			auto& transform = transforms[entities[i].index()];
+			transform.prevPos = transform.pos;
+			transform.prevAngle = transform.angle;
+		}
+
+		if (!supported(isa))
+			isa = Isa::Scalar;
+
+		switch (isa)
+		{
+#ifdef MOVEMENT_X86
+		case Isa::AVX2:		// see integrator()
+		case Isa::SSE2:
+			integrateSSE2(transforms, collisions, entities, count, params);
+			break;
+#endif
+		default:
+			integrateScalar(transforms, collisions, entities, count, params);
+			break;
+		}
+	}
+}
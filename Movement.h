@@ -0,0 +1,43 @@
+#ifndef MOVEMENT_H
+#define MOVEMENT_H
+
+#include "EntityManager.hpp"
+
+// Vectorized integrator used by Game::sMovement.
+// Transforms are loaded four at a time and transposed into x / y registers,
+// so the update and the wall bounce run on several entities per instruction.
+// The instruction set is picked at runtime, so the same binary runs on any x86-64
+// machine; other targets use the scalar version. The Isa check is shared with Narrowphase.
+namespace Movement
+{
+	enum class Isa { Scalar, SSE2, AVX2 };
+
+	struct Params
+	{
+		float				spin{ 0.0f };		// added to the angle every frame
+		const sf::Vector2u*	bounds{ nullptr };	// if set, velocity is reflected off these walls
+	};
+
+	// Best instruction set available on this machine
+	Isa detect();
+
+	// Best one for integrate. There is no AVX2 version: gathering eight transforms from the
+	// pool and transposing them made it no faster than SSE2 in the bench, AVX2 runs the SSE2 code
+	Isa integrator();
+
+	bool supported(Isa isa);
+
+	const char* name(Isa isa);
+
+	// pos += velocity and angle += spin for every entity, then bounce off the walls if
+	// params.bounds is set (using the entity's collision radius). Same results for every Isa.
+	// The old pos and angle are kept in prevPos / prevAngle.
+	void integrate(EntityManager& manager, const Entity* entities, size_t count, const Params& params, Isa isa);
+
+	inline void integrate(EntityManager& manager, const EntityVec& entities, const Params& params, Isa isa)
+	{
+		integrate(manager, entities.data(), entities.size(), params, isa);
+	}
+}
+
+#endif
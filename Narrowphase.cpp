@@ -0,0 +1,139 @@
+#include "Narrowphase.h"
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__x86_64__)
+#define NARROWPHASE_X86 1
+#include <immintrin.h>
+#endif
+
+// See Movement.cpp
+#if defined(__GNUC__) || defined(__clang__)
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+namespace Narrowphase
+{
+	// Everything about the moving circle the kernels need, worked out once per call
+	struct Sweep
+	{
+		float x, y;			// start
+		float px, py;		// path
+		float invLength;	// 1 / |path|^2, 0 for a circle that doesn't move
+		float radius;
+	};
+
+	// Circles [begin, count) one at a time, also handles the leftovers of the vector versions.
+	// The closest point of the path to each centre is start + path * t, with t clamped to 0..1
+	static size_t sweepScalar(const Sweep& s, const Circles& circles, size_t begin, uint64_t* mask)
+	{
+		size_t hits = 0;
+		for (size_t i = begin; i < circles.size(); ++i)
+		{
+			float dx = circles.x[i] - s.x;
+			float dy = circles.y[i] - s.y;
+			float t = std::clamp((dx * s.px + dy * s.py) * s.invLength, 0.0f, 1.0f);
+			float ex = dx - s.px * t;
+			float ey = dy - s.py * t;
+			float r = s.radius + circles.radius[i];
+
+			if (ex * ex + ey * ey <= r * r)
+			{
+				mask[i / 64] |= uint64_t(1) << (i % 64);
+				hits++;
+			}
+		}
+		return hits;
+	}
+
+#ifdef NARROWPHASE_X86
+
+	static size_t sweepSSE2(const Sweep& s, const Circles& circles, uint64_t* mask)
+	{
+		const __m128 sx = _mm_set1_ps(s.x), sy = _mm_set1_ps(s.y);
+		const __m128 px = _mm_set1_ps(s.px), py = _mm_set1_ps(s.py);
+		const __m128 invLength = _mm_set1_ps(s.invLength), radius = _mm_set1_ps(s.radius);
+		const __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+
+		size_t hits = 0, i = 0;
+		for (; i + 4 <= circles.size(); i += 4)
+		{
+			__m128 dx = _mm_sub_ps(_mm_loadu_ps(&circles.x[i]), sx);
+			__m128 dy = _mm_sub_ps(_mm_loadu_ps(&circles.y[i]), sy);
+			__m128 t = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(dx, px), _mm_mul_ps(dy, py)), invLength);
+			t = _mm_min_ps(_mm_max_ps(t, zero), one);
+			__m128 ex = _mm_sub_ps(dx, _mm_mul_ps(px, t));
+			__m128 ey = _mm_sub_ps(dy, _mm_mul_ps(py, t));
+			__m128 r = _mm_add_ps(radius, _mm_loadu_ps(&circles.radius[i]));
+
+			uint64_t bits = static_cast<uint64_t>(_mm_movemask_ps(_mm_cmple_ps(
+				_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(r, r))));
+			if (bits)
+			{
+				mask[i / 64] |= bits << (i % 64);
+				hits += std::popcount(bits);
+			}
+		}
+
+		return hits + sweepScalar(s, circles, i, mask);
+	}
+
+	// Same as sweepSSE2, eight circles at a time
+	TARGET_AVX2 static size_t sweepAVX2(const Sweep& s, const Circles& circles, uint64_t* mask)
+	{
+		const __m256 sx = _mm256_set1_ps(s.x), sy = _mm256_set1_ps(s.y);
+		const __m256 px = _mm256_set1_ps(s.px), py = _mm256_set1_ps(s.py);
+		const __m256 invLength = _mm256_set1_ps(s.invLength), radius = _mm256_set1_ps(s.radius);
+		const __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+
+		size_t hits = 0, i = 0;
+		for (; i + 8 <= circles.size(); i += 8)
+		{
+			__m256 dx = _mm256_sub_ps(_mm256_loadu_ps(&circles.x[i]), sx);
+			__m256 dy = _mm256_sub_ps(_mm256_loadu_ps(&circles.y[i]), sy);
+			__m256 t = _mm256_mul_ps(_mm256_add_ps(_mm256_mul_ps(dx, px), _mm256_mul_ps(dy, py)), invLength);
+			t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+			__m256 ex = _mm256_sub_ps(dx, _mm256_mul_ps(px, t));
+			__m256 ey = _mm256_sub_ps(dy, _mm256_mul_ps(py, t));
+			__m256 r = _mm256_add_ps(radius, _mm256_loadu_ps(&circles.radius[i]));
+
+			uint64_t bits = static_cast<uint64_t>(_mm256_movemask_ps(_mm256_cmp_ps(
+				_mm256_add_ps(_mm256_mul_ps(ex, ex), _mm256_mul_ps(ey, ey)), _mm256_mul_ps(r, r), _CMP_LE_OQ)));
+			if (bits)
+			{
+				mask[i / 64] |= bits << (i % 64);
+				hits += std::popcount(bits);
+			}
+		}
+
+		// The leftovers run as SSE code, which is slow while the upper halves of the registers are dirty
+		_mm256_zeroupper();
+		return hits + sweepScalar(s, circles, i, mask);
+	}
+
+#endif // NARROWPHASE_X86
+
+	size_t sweep(const Vec2f& start, const Vec2f& path, float radius, const Circles& circles, std::vector<uint64_t>& mask, Isa isa)
+	{
+		mask.assign((circles.size() + 63) / 64, 0);
+
+		float length = path.x * path.x + path.y * path.y;
+		Sweep s{ start.x, start.y, path.x, path.y, length > 0.0f ? 1.0f / length : 0.0f, radius };
+
+		if (!Movement::supported(isa))
+			isa = Isa::Scalar;
+
+		switch (isa)
+		{
+#ifdef NARROWPHASE_X86
+		case Isa::AVX2:
+			return sweepAVX2(s, circles, mask.data());
+		case Isa::SSE2:
+			return sweepSSE2(s, circles, mask.data());
+#endif
+		default:
+			return sweepScalar(s, circles, 0, mask.data());
+		}
+	}
+}
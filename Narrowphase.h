@@ -0,0 +1,61 @@
+#ifndef NARROWPHASE_H
+#define NARROWPHASE_H
+
+#include "Vec2.hpp"
+#include "Movement.h"
+#include <bit>
+#include <cstdint>
+#include <vector>
+
+// Batch narrowphase used by Game::sCollision.
+// The candidates the broadphase returns for one bullet are packed into separate x / y / radius
+// arrays, so each load brings in four or eight of them and the squared distance compare runs on
+// all of them at once. The result is a bit mask, only the few set bits need any further work.
+// Uses the same instruction sets, and the same runtime check, as Movement.
+namespace Narrowphase
+{
+	using Isa = Movement::Isa;
+
+	// Circles packed one field per array
+	struct Circles
+	{
+		std::vector<float>		x, y, radius;
+		std::vector<uint32_t>	index;		// whatever the caller wants back for each circle, e.g. its place in a tag list
+
+		void clear()
+		{
+			x.clear();
+			y.clear();
+			radius.clear();
+			index.clear();
+		}
+
+		void push(const Vec2f& pos, float r, uint32_t i)
+		{
+			x.push_back(pos.x);
+			y.push_back(pos.y);
+			radius.push_back(r);
+			index.push_back(i);
+		}
+
+		size_t size() const { return x.size(); }
+	};
+
+	// Sets bit i of mask[i / 64] for every circle that a circle of the given radius touches while
+	// moving from start to start + path, by the squared distance from each centre to the path.
+	// A zero path is the plain overlap test. Same results for every Isa, returns the number of hits
+	size_t sweep(const Vec2f& start, const Vec2f& path, float radius, const Circles& circles, std::vector<uint64_t>& mask, Isa isa);
+
+	// Calls f(i) for every bit set in the mask, lowest first
+	template <typename F>
+	void forEachHit(const std::vector<uint64_t>& mask, F&& f)
+	{
+		for (size_t word = 0; word < mask.size(); ++word)
+		{
+			for (uint64_t bits = mask[word]; bits != 0; bits &= bits - 1)
+				f(word * 64 + std::countr_zero(bits));
+		}
+	}
+}
+
+#endif
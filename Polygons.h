@@ -0,0 +1,53 @@
+#ifndef POLYGONS_H
+#define POLYGONS_H
+
+#include "Vec2.hpp"
+#include <vector>
+#include <cmath>
+
+// Shared table of unit regular polygons, one per point count, so rendering and spawning
+// transform precomputed corner offsets instead of calling cos/sin per vertex.
+// Corners follow sf::CircleShape: the first one points up and they go clockwise.
+// Tables are built the first time a point count is asked for; call warm() on the main thread
+// for every count in use before anything reads the table from another thread.
+namespace Polygons
+{
+	struct Polygon
+	{
+		std::vector<Vec2f>	corners;				// unit offsets from the centre
+		float				outlineScale{ 1.0f };	// corner distance of a unit-thickness outline, 1 / cos(pi / n)
+	};
+
+	// Indexed by point count. The inline keyword gives one table for the whole program.
+	inline std::vector<Polygon> table;
+
+	inline const Polygon& get(size_t points)
+	{
+		if (points >= table.size())
+			table.resize(points + 1);
+
+		Polygon& polygon = table[points];
+		if (polygon.corners.empty() && points > 0)
+		{
+			const float pi = 3.14159265f;
+			polygon.corners.reserve(points);
+			for (size_t i = 0; i < points; ++i)
+			{
+				float angle = i * 2 * pi / points - pi / 2;
+				polygon.corners.emplace_back(std::cos(angle), std::sin(angle));
+			}
+			polygon.outlineScale = 1.0f / std::cos(pi / points);
+		}
+
+		return polygon;
+	}
+
+	// Builds the tables for every point count in [min, max]
+	inline void warm(size_t min, size_t max)
+	{
+		for (size_t points = min; points <= max; ++points)
+			get(points);
+	}
+}
+
+#endif
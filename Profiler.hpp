@@ -0,0 +1,134 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "Trace.h"
+
+// Build with PROFILER_ENABLED=0 to compile every PROFILE_SCOPE out
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+// Frame profiler: named sections are timed with PROFILE_SCOPE and the time spent in each one
+// is summed per frame into a ring buffer of the last FRAMES frames. Recording is two clock
+// reads and an add per scope, the statistics are only worked out when something asks for them.
+// While a Trace is running every scope and frame is also sent to it.
+class Profiler
+{
+public:
+	static constexpr size_t FRAMES = 240;
+	using Section = uint8_t;
+
+	struct Stats { float last{ 0 }, min{ 0 }, avg{ 0 }, p99{ 0 }; };	// milliseconds
+
+	// Times the rest of the enclosing block
+	class Scope
+	{
+		Profiler&								m_profiler;
+		Section									m_section;
+		std::chrono::steady_clock::time_point	m_start;
+
+	public:
+		Scope(Profiler& profiler, Section section)
+			: m_profiler(profiler), m_section(section), m_start(std::chrono::steady_clock::now()) {}
+
+		~Scope()
+		{
+			auto end = std::chrono::steady_clock::now();
+			m_profiler.record(m_section, std::chrono::duration<float, std::milli>(end - m_start).count());
+			if (Trace::active())
+				Trace::complete(m_profiler.name(m_section).c_str(), m_start, end);
+		}
+
+		Scope(const Scope&) = delete;
+		Scope& operator=(const Scope&) = delete;
+	};
+
+private:
+	std::vector<std::string>					m_names;
+	std::vector<std::array<float, FRAMES>>		m_samples;		// per section, indexed by frame % FRAMES
+	size_t										m_frame{ 0 };	// frames started so far
+	std::chrono::steady_clock::time_point		m_frameStart;
+
+	size_t current() const { return m_frame % FRAMES; }
+
+public:
+	Section add(const std::string& name)
+	{
+		m_names.push_back(name);
+		m_samples.emplace_back();
+		m_samples.back().fill(0.0f);
+		return static_cast<Section>(m_names.size() - 1);
+	}
+
+	// Starts recording into the next slot, dropping the oldest frame once the buffer is full
+	void beginFrame()
+	{
+		auto now = std::chrono::steady_clock::now();
+		if (Trace::active() && m_frame > 0)
+			Trace::complete("Frame", m_frameStart, now);
+		m_frameStart = now;
+
+		m_frame++;
+		for (auto& samples : m_samples)
+			samples[current()] = 0.0f;
+	}
+
+	// Adds ms to the section's time for this frame, a section can be entered more than once
+	void record(Section section, float ms)
+	{
+		m_samples[section][current()] += ms;
+	}
+
+	size_t sections() const { return m_names.size(); }
+	const std::string& name(Section section) const { return m_names[section]; }
+
+	// Number of completed frames in the buffer, the one being recorded doesn't count
+	size_t frames() const { return m_frame > 0 ? std::min(m_frame - 1, FRAMES - 1) : 0; }
+
+	// Time of a completed frame, age 0 is the last one
+	float sample(Section section, size_t age) const
+	{
+		return m_samples[section][(m_frame + FRAMES - 1 - age) % FRAMES];
+	}
+
+	// Over the completed frames in the buffer
+	Stats stats(Section section) const
+	{
+		Stats stats;
+		size_t count = frames();
+		if (count == 0)
+			return stats;
+
+		std::array<float, FRAMES> sorted;
+		for (size_t age = 0; age < count; ++age)
+			sorted[age] = sample(section, age);
+
+		float total = 0.0f;
+		for (size_t i = 0; i < count; ++i)
+			total += sorted[i];
+
+		stats.last = sorted[0];
+		stats.avg = total / count;
+		size_t p99 = std::min(count - 1, count * 99 / 100);
+		std::nth_element(sorted.begin(), sorted.begin() + p99, sorted.begin() + count);
+		stats.p99 = sorted[p99];
+		stats.min = *std::min_element(sorted.begin(), sorted.begin() + p99 + 1);
+		return stats;
+	}
+};
+
+#if PROFILER_ENABLED
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(profiler, section) Profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(profiler, section)
+#else
+#define PROFILE_SCOPE(profiler, section) ((void)0)
+#endif
+
+#endif
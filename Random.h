@@ -1,78 +1,128 @@
-#ifndef RANDOM_MT_H
-#define RANDOM_MT_H
+#ifndef RANDOM_H
+#define RANDOM_H
 
 #include <chrono>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 
-// This header-only Random namespace implements a self-seeding Mersenne Twister.
-// Requires C++17 or newer.
-// It can be #included into as many code files as needed (The inline keyword avoids ODR violations)
-// Freely redistributable, courtesy of learncpp.com (https://www.learncpp.com/cpp-tutorial/global-random-numbers-random-h/)
+// Header-only random numbers built on PCG32 (https://www.pcg-random.org).
+// The generator is 16 bytes, a handful of instructions per number, and every seed has
+// 2^63 independent streams. Ranges are mapped with integer math only, so the same seed
+// gives the same numbers with every compiler and standard library, which replays rely on.
+//
+// Anything that runs in parallel should use its own Generator from Random::stream() rather
+// than the shared one behind Random::get.
 namespace Random
 {
-	// Returns a seeded Mersenne Twister
-	// Note: we'd prefer to return a std::seed_seq (to initialize a std::mt19937), but std::seed can't be copied, so it can't be returned by value.
-	// Instead, we'll create a std::mt19937, seed it, and then return the std::mt19937 (which can be copied).
-	inline std::mt19937 generate()
+	class Generator
 	{
-		std::random_device rd{};
+		uint64_t m_state{ 0 };
+		uint64_t m_increment{ 1 };
 
-		// Create seed_seq with clock and 7 random numbers from std::random_device
-		std::seed_seq ss{
-			static_cast<std::seed_seq::result_type>(std::chrono::steady_clock::now().time_since_epoch().count()),
-				rd(), rd(), rd(), rd(), rd(), rd(), rd() };
+	public:
+		Generator(uint64_t seed = 0x853c49e6748fea9bULL, uint64_t stream = 0)
+		{
+			this->seed(seed, stream);
+		}
 
-		return std::mt19937{ ss };
-	}
+		void seed(uint64_t seed, uint64_t stream = 0)
+		{
+			m_state = 0;
+			m_increment = stream << 1 | 1;
+			next();
+			m_state += seed;
+			next();
+		}
 
-	// Here's our global std::mt19937 object.
-	// The inline keyword means we only have one global instance for our whole program.
-	inline std::mt19937 mt{ generate() }; // generates a seeded std::mt19937 and copies it into our global object
+		// Uniform 32 bits
+		uint32_t next()
+		{
+			uint64_t old = m_state;
+			m_state = old * 6364136223846793005ULL + m_increment;
+			uint32_t xorshifted = static_cast<uint32_t>(((old >> 18) ^ old) >> 27);
+			uint32_t rotation = static_cast<uint32_t>(old >> 59);
+			return (xorshifted >> rotation) | (xorshifted << ((32 - rotation) & 31));
+		}
 
-	// Generate a random int between [min, max] (inclusive)
-		// * also handles cases where the two arguments have different types but can be converted to int
-	inline int get(int min, int max)
+		// Uniform in [0, bound), multiply and reject (Lemire) instead of a biased modulo
+		uint32_t below(uint32_t bound)
+		{
+			uint64_t m = static_cast<uint64_t>(next()) * bound;
+			if (static_cast<uint32_t>(m) < bound)
+			{
+				uint32_t threshold = (0u - bound) % bound;
+				while (static_cast<uint32_t>(m) < threshold)
+					m = static_cast<uint64_t>(next()) * bound;
+			}
+			return static_cast<uint32_t>(m >> 32);
+		}
+
+		// Random int between [min, max] (inclusive)
+		int get(int min, int max)
+		{
+			uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max) - min + 1);
+			return static_cast<int>(min + static_cast<int64_t>(range ? below(range) : next()));
+		}
+
+		// Random float between [min, max)
+		float get(float min, float max)
+		{
+			return min + (max - min) * ((next() >> 8) * 0x1.0p-24f);
+		}
+
+		// Batch versions for large spawns, count values written to out
+		void fill(int* out, size_t count, int min, int max)
+		{
+			for (size_t i = 0; i < count; ++i)
+				out[i] = get(min, max);
+		}
+
+		void fill(float* out, size_t count, float min, float max)
+		{
+			for (size_t i = 0; i < count; ++i)
+				out[i] = get(min, max);
+		}
+	};
+
+	// Named streams, so a system keeps its own sequence no matter what else draws numbers
+	enum Stream : uint64_t { Shared, Spawning, Bench };
+
+	// Seed of the current run, every stream is derived from it
+	inline uint64_t baseSeed{ 0 };
+
+	// Shared generator behind Random::get, main thread only
+	inline Generator shared{ 0, Shared };
+
+	// A fresh seed from std::random_device and the clock, for runs that don't need to be repeated
+	inline uint64_t makeSeed()
 	{
-		return std::uniform_int_distribution{ min, max }(mt);
+		std::random_device rd{};
+		return (static_cast<uint64_t>(rd()) << 32 | rd()) ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
 	}
 
-	// Generates random float between [min, max)
-	inline float get(float min, float max)
+	// Restarts every sequence, the same seed always gives the same numbers.
+	// Replays rely on this, so anything random in the simulation must come from a Generator
+	inline void seed(uint64_t value)
 	{
-		return std::uniform_real_distribution{ min, max + 0.0001f }(mt);
+		baseSeed = value;
+		shared.seed(value, Shared);
 	}
 
-	// The following function templates can be used to generate random numbers in other cases
-
-	// See https://www.learncpp.com/cpp-tutorial/function-template-instantiation/
-	// You can ignore these if you don't understand them
-
-	// Generate a random value between [min, max] (inclusive)
-	// * min and max must have the same type
-	// * return value has same type as min and max
-	// * Supported types:
-	// *    short, int, long, long long
-	// *    unsigned short, unsigned int, unsigned long, or unsigned long long
-	// Sample call: Random::get(1L, 6L);             // returns long
-	// Sample call: Random::get(1u, 6u);             // returns unsigned int
-	template <typename T>
-	T get(T min, T max)
+	// Independent generator for one system
+	inline Generator stream(uint64_t id)
 	{
-		return std::uniform_int_distribution<T>{min, max}(mt);
+		return Generator(baseSeed, id);
 	}
 
-	
-	// Generate a random value between [min, max] (inclusive)
-	// * min and max can have different types
-		// * return type must be explicitly specified as a template argument
-	// * min and max will be converted to the return type
-	// Sample call: Random::get<std::size_t>(0, 6);  // returns std::size_t
-	// Sample call: Random::get<std::size_t>(0, 6u); // returns std::size_t
-	// Sample call: Random::get<std::int>(0, 6u);    // returns int
-	template <typename R, typename S, typename T>
-	R get(S min, T max)
+	inline int get(int min, int max)
+	{
+		return shared.get(min, max);
+	}
+
+	inline float get(float min, float max)
 	{
-		return get<R>(static_cast<R>(min), static_cast<R>(max));
+		return shared.get(min, max);
 	}
 }
 
@@ -0,0 +1,108 @@
+#include "Replay.h"
+#include <algorithm>
+
+namespace Replay
+{
+	static const char		MAGIC[4] = { 'G', 'W', 'R', 'P' };
+	static const uint16_t	VERSION = 1;
+	static const uint8_t	MANY_EVENTS = 15;	// event count doesn't fit in the tick byte
+
+	// Raw little endian values, every platform the game builds for is little endian
+	template <typename T>
+	static void put(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	static bool take(std::ifstream& file, T& value)
+	{
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	bool Writer::open(const std::string& path, uint64_t seed)
+	{
+		m_file.open(path, std::ios::binary | std::ios::trunc);
+		if (!m_file)
+			return false;
+
+		m_file.write(MAGIC, sizeof(MAGIC));
+		put(m_file, VERSION);
+		put(m_file, seed);
+		m_ticks = 0;
+		return true;
+	}
+
+	void Writer::write(const CInput& input, const std::vector<InputEvent>& events)
+	{
+		uint8_t keys = input.up | input.left << 1 | input.right << 2 | input.down << 3;
+		uint8_t count = events.size() < MANY_EVENTS ? static_cast<uint8_t>(events.size()) : MANY_EVENTS;
+		put(m_file, static_cast<uint8_t>(keys | count << 4));
+		if (count == MANY_EVENTS)
+			put(m_file, static_cast<uint16_t>(events.size()));
+
+		for (auto& event : events)
+		{
+			put(m_file, static_cast<uint8_t>(event.type));
+			put(m_file, event.target.x);
+			put(m_file, event.target.y);
+		}
+		m_ticks++;
+	}
+
+	void Writer::close()
+	{
+		m_file.close();
+	}
+
+	bool Reader::open(const std::string& path)
+	{
+		m_file.open(path, std::ios::binary);
+		if (!m_file)
+			return false;
+
+		char magic[4];
+		uint16_t version = 0;
+		m_file.read(magic, sizeof(magic));
+		take(m_file, version);
+		if (!m_file || !std::equal(magic, magic + 4, MAGIC) || version != VERSION || !take(m_file, m_seed))
+		{
+			m_file.close();
+			return false;
+		}
+		return true;
+	}
+
+	bool Reader::next(CInput& input, std::vector<InputEvent>& events)
+	{
+		uint8_t tick = 0;
+		if (!take(m_file, tick))
+			return false;
+
+		input.up = tick & 1;
+		input.left = tick & 2;
+		input.right = tick & 4;
+		input.down = tick & 8;
+
+		size_t count = tick >> 4;
+		if (count == MANY_EVENTS)
+		{
+			uint16_t many = 0;
+			take(m_file, many);
+			count = many;
+		}
+
+		events.clear();
+		for (size_t i = 0; i < count; ++i)
+		{
+			uint8_t type = 0;
+			InputEvent event;
+			if (!take(m_file, type) || !take(m_file, event.target.x) || !take(m_file, event.target.y))
+				return false;
+
+			event.type = static_cast<InputEvent::Type>(type);
+			events.push_back(event);
+		}
+		return true;
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "Components.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Something the player did that is applied at the start of the next tick
+struct InputEvent
+{
+	enum Type : uint8_t { Shoot, Special, SpawnEnemy };
+
+	Type	type{ Shoot };
+	Vec2f	target{ 0.0f, 0.0f };	// mouse position for Shoot
+	bool	applied{ false };		// already done while paused, only recorded. Not saved, a replay applies it
+};
+
+// Binary record of a play session: the RNG seed, then for every tick the player's movement
+// keys and the input events since the previous tick. Feeding them back through Game::update
+// with the same seed and config reproduces the session exactly.
+//
+// Layout (little endian): "GWRP", uint16 version, uint64 seed, then per tick one byte with
+// the up/left/right/down bits low and the event count high (15 means a uint16 count follows),
+// then each event as uint8 type, float x, float y. An idle tick is a single byte.
+namespace Replay
+{
+	class Writer
+	{
+		std::ofstream	m_file;
+		size_t			m_ticks{ 0 };
+
+	public:
+		bool open(const std::string& path, uint64_t seed);
+		bool isOpen() const { return m_file.is_open(); }
+		size_t ticks() const { return m_ticks; }
+
+		void write(const CInput& input, const std::vector<InputEvent>& events);
+		void close();
+	};
+
+	class Reader
+	{
+		std::ifstream	m_file;
+		uint64_t		m_seed{ 0 };
+
+	public:
+		bool open(const std::string& path);
+		uint64_t seed() const { return m_seed; }
+
+		// Reads the next tick, returns false at the end of the file
+		bool next(CInput& input, std::vector<InputEvent>& events);
+	};
+}
+
+#endif
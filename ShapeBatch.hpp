@@ -0,0 +1,97 @@
+#ifndef SHAPEBATCH_HPP
+#define SHAPEBATCH_HPP
+
+#include "Vec2.hpp"
+#include "Polygons.h"
+#include "Components.hpp"
+#include <SFML/Graphics.hpp>
+#include <cmath>
+
+// Collects the fill and outline triangles of many circle shapes into one vertex array,
+// so a whole frame of entities is submitted with a single draw call.
+// Produces the same geometry sf::CircleShape does: points start at the top and go clockwise,
+// and the outline grows outwards from the edge by the outline thickness.
+class ShapeBatch
+{
+	sf::VertexArray	m_vertices{ sf::PrimitiveType::Triangles };
+	size_t			m_shapes{ 0 };
+
+	void triangle(const sf::Vector2f& a, const sf::Vector2f& b, const sf::Vector2f& c, const sf::Color& color)
+	{
+		m_vertices.append({ a, color, {} });
+		m_vertices.append({ b, color, {} });
+		m_vertices.append({ c, color, {} });
+	}
+
+public:
+	ShapeBatch() = default;
+
+	// Start a new frame, keeps the allocated vertex storage
+	void clear()
+	{
+		m_vertices.clear();
+		m_shapes = 0;
+	}
+
+	// Adds a shape centred on pos and rotated by angle (in degrees), drawn after the ones before it.
+	// alpha scales the shape's own fill and outline alpha
+	void add(const CShape& shape, const Vec2f& pos, float angle, uint8_t alpha = 255)
+	{
+		const Polygons::Polygon& polygon = Polygons::get(shape.points);
+		size_t points = polygon.corners.size();
+		float radius = shape.radius;
+		float thickness = shape.thickness;
+		sf::Color fill = shape.fillColor();
+		sf::Color outline = shape.outlineColor();
+		fill.a = static_cast<uint8_t>(fill.a * alpha / 255);
+		outline.a = static_cast<uint8_t>(outline.a * alpha / 255);
+
+		// One rotation per shape, every corner is then a scaled and rotated unit offset
+		float rotation = angle * 3.14159265f / 180.0f;
+		float c = std::cos(rotation), s = std::sin(rotation);
+		float outerRadius = radius + thickness * polygon.outlineScale;
+		sf::Vector2f centre(pos.x, pos.y);
+
+		auto corner = [&](size_t i, float r)
+		{
+			const Vec2f& unit = polygon.corners[i == points ? 0 : i];
+			return sf::Vector2f(centre.x + (unit.x * c - unit.y * s) * r, centre.y + (unit.x * s + unit.y * c) * r);
+		};
+
+		// Fill as a fan of triangles around the centre
+		for (size_t i = 0; i < points; ++i)
+			triangle(centre, corner(i, radius), corner(i + 1, radius), fill);
+
+		// Outline as a quad per edge between the inner and outer corners
+		if (thickness != 0.0f)
+		{
+			for (size_t i = 0; i < points; ++i)
+			{
+				sf::Vector2f inner0 = corner(i, radius), inner1 = corner(i + 1, radius);
+				sf::Vector2f outer0 = corner(i, outerRadius), outer1 = corner(i + 1, outerRadius);
+				triangle(inner0, outer0, outer1, outline);
+				triangle(inner0, outer1, inner1, outline);
+			}
+		}
+
+		m_shapes++;
+	}
+
+	void draw(sf::RenderTarget& target) const
+	{
+		if (m_vertices.getVertexCount() > 0)
+			target.draw(m_vertices);
+	}
+
+	size_t vertexCount() const
+	{
+		return m_vertices.getVertexCount();
+	}
+
+	size_t shapeCount() const
+	{
+		return m_shapes;
+	}
+};
+
+#endif // !SHAPEBATCH_HPP
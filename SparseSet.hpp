@@ -0,0 +1,134 @@
+#ifndef SPARSESET_HPP
+#define SPARSESET_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Storage for a component type that only a few entities have, outside of ComponentTuple.
+// The components are packed in one vector with the slot each belongs to alongside, and a
+// slot -> position table finds them, so add, remove and has are constant time and only the
+// owners pay for the component itself. The table is split in pages that are allocated when
+// a slot in them first gets the component, an unused range of slots costs one pointer per page.
+class SparseSetBase
+{
+public:
+	virtual ~SparseSetBase() = default;
+
+	// Does nothing if the slot doesn't have the component
+	virtual void remove(uint32_t slot) = 0;
+	virtual bool has(uint32_t slot) const = 0;
+	virtual size_t size() const = 0;
+	virtual size_t bytes() const = 0;		// allocated, for stats
+};
+
+template <typename T>
+class SparseSet : public SparseSetBase
+{
+	static constexpr uint32_t PAGE = 256;			// slots per page of the table
+	static constexpr uint32_t NONE = UINT32_MAX;
+
+	std::vector<std::unique_ptr<uint32_t[]>>	m_pages;	// slot -> position in m_dense, null until used
+	std::vector<T>								m_dense;
+	std::vector<uint32_t>						m_slots;	// position -> slot
+
+	uint32_t* find(uint32_t slot) const
+	{
+		size_t page = slot / PAGE;
+		if (page >= m_pages.size() || !m_pages[page] || m_pages[page][slot % PAGE] == NONE)
+			return nullptr;
+		return &m_pages[page][slot % PAGE];
+	}
+
+public:
+	bool has(uint32_t slot) const override
+	{
+		return find(slot) != nullptr;
+	}
+
+	T& get(uint32_t slot)
+	{
+		uint32_t* position = find(slot);
+		assert(position);
+		return m_dense[*position];
+	}
+
+	// Replaces the component if the slot already has one
+	T& add(uint32_t slot, T component)
+	{
+		if (uint32_t* position = find(slot))
+			return m_dense[*position] = std::move(component);
+
+		size_t page = slot / PAGE;
+		if (page >= m_pages.size())
+			m_pages.resize(page + 1);
+		if (!m_pages[page])
+		{
+			m_pages[page] = std::make_unique<uint32_t[]>(PAGE);
+			std::fill(m_pages[page].get(), m_pages[page].get() + PAGE, NONE);
+		}
+
+		m_pages[page][slot % PAGE] = static_cast<uint32_t>(m_dense.size());
+		m_slots.push_back(slot);
+		m_dense.push_back(std::move(component));
+		return m_dense.back();
+	}
+
+	// The last component fills the hole, so the order of the others changes
+	void remove(uint32_t slot) override
+	{
+		uint32_t* position = find(slot);
+		if (!position)
+			return;
+
+		uint32_t moved = *position;
+		m_dense[moved] = std::move(m_dense.back());
+		m_slots[moved] = m_slots.back();
+		m_pages[m_slots[moved] / PAGE][m_slots[moved] % PAGE] = moved;
+		m_dense.pop_back();
+		m_slots.pop_back();
+		*position = NONE;
+	}
+
+	size_t size() const override
+	{
+		return m_dense.size();
+	}
+
+	size_t bytes() const override
+	{
+		size_t pages = 0;
+		for (auto& page : m_pages)
+			pages += page ? PAGE * sizeof(uint32_t) : 0;
+
+		return m_pages.capacity() * sizeof(m_pages[0]) + pages
+			+ m_dense.capacity() * sizeof(T) + m_slots.capacity() * sizeof(uint32_t);
+	}
+
+	// Calls f(slot, component) for every owner, in no particular order
+	template <typename F>
+	void each(F&& f)
+	{
+		for (size_t i = 0; i < m_dense.size(); ++i)
+			f(m_slots[i], m_dense[i]);
+	}
+};
+
+// Sparse component types are numbered the first time they are used, in any EntityManager
+inline size_t nextSparseTypeId()
+{
+	static std::atomic<size_t> next{ 0 };
+	return next++;
+}
+
+template <typename T>
+size_t sparseTypeId()
+{
+	static const size_t id = nextSparseTypeId();
+	return id;
+}
+
+#endif // !SPARSESET_HPP
@@ -0,0 +1,107 @@
+#ifndef SPATIALGRID_HPP
+#define SPATIALGRID_HPP
+
+#include "EntityManager.hpp"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Uniform grid broadphase over the arena.
+// Each entity is stored in the cell containing its centre, so a query only has to look at the
+// cells overlapped by the query circle grown by the largest radius in the grid.
+// Entities outside the arena (e.g. bullets that flew off screen) are clamped into the edge cells.
+// The grid stores indices into the EntityVec it was built from and is rebuilt every frame.
+class SpatialGrid
+{
+	float					m_cellSize{ 64.0f };
+	float					m_maxRadius{ 0.0f };
+	int						m_cols{ 1 };
+	int						m_rows{ 1 };
+	std::vector<uint32_t>	m_cellStart;	// cell i holds m_entries[m_cellStart[i] .. m_cellStart[i + 1])
+	std::vector<uint32_t>	m_entries;		// entity indices, sorted by cell
+	std::vector<int>		m_cellOf;		// cell of each entity while building, -1 if skipped
+
+	int column(float x) const
+	{
+		return std::clamp(static_cast<int>(std::floor(x / m_cellSize)), 0, m_cols - 1);
+	}
+
+	int row(float y) const
+	{
+		return std::clamp(static_cast<int>(std::floor(y / m_cellSize)), 0, m_rows - 1);
+	}
+
+public:
+	SpatialGrid() = default;
+
+	void build(const EntityVec& entities, const sf::Vector2u& arena)
+	{
+		// Cells are twice the largest radius so big enemies only reach into neighbouring cells
+		m_maxRadius = 0.0f;
+		for (auto& e : entities)
+		{
+			if (e.isActive())
+				m_maxRadius = std::max(m_maxRadius, e.get<CCollision>().radius);
+		}
+
+		m_cellSize = std::max(2.0f * m_maxRadius, 16.0f);
+		m_cols = std::max(1, static_cast<int>(std::ceil(arena.x / m_cellSize)));
+		m_rows = std::max(1, static_cast<int>(std::ceil(arena.y / m_cellSize)));
+
+		// Counting sort of the entities by cell
+		m_cellStart.assign(m_cols * m_rows + 1, 0);
+		m_cellOf.resize(entities.size());
+
+		for (size_t i = 0; i < entities.size(); ++i)
+		{
+			if (!entities[i].isActive())
+			{
+				m_cellOf[i] = -1;
+				continue;
+			}
+
+			const Vec2f& pos = entities[i].get<CTransform>().pos;
+			m_cellOf[i] = row(pos.y) * m_cols + column(pos.x);
+			m_cellStart[m_cellOf[i] + 1]++;
+		}
+
+		for (size_t c = 1; c < m_cellStart.size(); ++c)
+			m_cellStart[c] += m_cellStart[c - 1];
+
+		m_entries.resize(m_cellStart.back());
+		std::vector<uint32_t> next(m_cellStart.begin(), m_cellStart.end() - 1);
+
+		for (size_t i = 0; i < entities.size(); ++i)
+		{
+			if (m_cellOf[i] >= 0)
+				m_entries[next[m_cellOf[i]]++] = static_cast<uint32_t>(i);
+		}
+	}
+
+	// Calls f(index) for every entity that may overlap the circle at pos with the given radius.
+	// Stops early and returns true as soon as f returns true.
+	template <typename F>
+	bool query(const Vec2f& pos, float radius, F&& f) const
+	{
+		float reach = radius + m_maxRadius;
+		int c0 = column(pos.x - reach), c1 = column(pos.x + reach);
+		int r0 = row(pos.y - reach), r1 = row(pos.y + reach);
+
+		for (int r = r0; r <= r1; ++r)
+		{
+			for (int c = c0; c <= c1; ++c)
+			{
+				int cell = r * m_cols + c;
+				for (uint32_t i = m_cellStart[cell]; i < m_cellStart[cell + 1]; ++i)
+				{
+					if (f(m_entries[i]))
+						return true;
+				}
+			}
+		}
+
+		return false;
+	}
+};
+
+#endif // !SPATIALGRID_HPP
@@ -0,0 +1,130 @@
+#ifndef SWEEPANDPRUNE_HPP
+#define SWEEPANDPRUNE_HPP
+
+#include "EntityManager.hpp"
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+// Sort-and-sweep broadphase along the x axis.
+// Entities are kept sorted by x from one frame to the next, and since most of them only move
+// a few pixels per tick last frame's order is nearly right: an insertion sort fixes it in about
+// linear time. Entities that are new this frame are sorted on their own and merged in.
+// Unlike the grid there is no cell size to tune, so clusters and sparse areas cost the same.
+// Like SpatialGrid, it hands out indices into the EntityVec it was built from.
+class SweepAndPrune
+{
+	struct Item
+	{
+		float		x, y, radius;
+		uint32_t	index;		// into the EntityVec given to build
+		Entity		entity;
+	};
+
+	std::vector<Item>		m_items;		// sorted by x
+	float					m_maxRadius{ 0.0f };
+	size_t					m_moves{ 0 };	// insertion sort shifts in the last build
+	std::vector<uint32_t>	m_slotFrame;	// per entity slot, the build that last saw it
+	std::vector<uint32_t>	m_slotIndex;	// per entity slot, its index in the list that build
+	std::vector<uint8_t>	m_sorted;		// per list index, already placed from last frame's order
+	uint32_t				m_frame{ 0 };
+
+public:
+	SweepAndPrune() = default;
+
+	void build(const EntityVec& entities)
+	{
+		// Where every live entity is in the list this frame, by slot
+		m_frame++;
+		for (size_t i = 0; i < entities.size(); ++i)
+		{
+			if (!entities[i].isActive())
+				continue;
+
+			uint32_t slot = entities[i].index();
+			if (slot >= m_slotFrame.size())
+			{
+				m_slotFrame.resize(slot + 1, 0);
+				m_slotIndex.resize(slot + 1, 0);
+			}
+			m_slotFrame[slot] = m_frame;
+			m_slotIndex[slot] = static_cast<uint32_t>(i);
+		}
+
+		// Keep last frame's order for everything still alive, with this frame's positions
+		m_sorted.assign(entities.size(), 0);
+		m_maxRadius = 0.0f;
+		size_t kept = 0;
+		for (const Item& item : m_items)
+		{
+			uint32_t slot = item.entity.index();
+			if (m_slotFrame[slot] != m_frame || !(entities[m_slotIndex[slot]] == item.entity))
+				continue;
+
+			uint32_t i = m_slotIndex[slot];
+			const Vec2f& pos = item.entity.get<CTransform>().pos;
+			float radius = item.entity.get<CCollision>().radius;
+			m_items[kept++] = { pos.x, pos.y, radius, i, item.entity };
+			m_sorted[i] = 1;
+			m_maxRadius = std::max(m_maxRadius, radius);
+		}
+		m_items.resize(kept);
+
+		// Insertion sort, close to linear while the order barely changes
+		m_moves = 0;
+		for (size_t i = 1; i < m_items.size(); ++i)
+		{
+			Item item = m_items[i];
+			size_t j = i;
+			for (; j > 0 && m_items[j - 1].x > item.x; --j)
+				m_items[j] = m_items[j - 1];
+
+			m_moves += i - j;
+			m_items[j] = item;
+		}
+
+		// Newcomers are sorted separately, then merged into the rest
+		for (size_t i = 0; i < entities.size(); ++i)
+		{
+			if (m_sorted[i] || !entities[i].isActive())
+				continue;
+
+			const Vec2f& pos = entities[i].get<CTransform>().pos;
+			float radius = entities[i].get<CCollision>().radius;
+			m_items.push_back({ pos.x, pos.y, radius, static_cast<uint32_t>(i), entities[i] });
+			m_maxRadius = std::max(m_maxRadius, radius);
+		}
+
+		auto byX = [](const Item& a, const Item& b) { return a.x < b.x; };
+		std::sort(m_items.begin() + kept, m_items.end(), byX);
+		std::inplace_merge(m_items.begin(), m_items.begin() + kept, m_items.end(), byX);
+	}
+
+	// Calls f(index) for every entity whose bounding box overlaps the one of the circle at pos.
+	// Stops early and returns true as soon as f returns true.
+	template <typename F>
+	bool query(const Vec2f& pos, float radius, F&& f) const
+	{
+		// Sorted by centre, so anything that can reach pos is within the largest radius of it
+		float reach = radius + m_maxRadius;
+		auto first = std::lower_bound(m_items.begin(), m_items.end(), pos.x - reach,
+			[](const Item& item, float x) { return item.x < x; });
+
+		for (auto it = first; it != m_items.end() && it->x <= pos.x + reach; ++it)
+		{
+			float r = radius + it->radius;
+			if (std::abs(it->x - pos.x) > r || std::abs(it->y - pos.y) > r)
+				continue;
+
+			if (f(it->index))
+				return true;
+		}
+
+		return false;
+	}
+
+	size_t size() const { return m_items.size(); }
+	size_t moves() const { return m_moves; }
+};
+
+#endif // !SWEEPANDPRUNE_HPP
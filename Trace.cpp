@@ -0,0 +1,146 @@
+#include "Trace.h"
+#include "Log.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace Trace
+{
+	struct Event
+	{
+		char				name[32];
+		Clock::time_point	begin;
+		Clock::time_point	end;
+		uint32_t			thread;
+	};
+
+	static std::mutex						s_mutex;		// guards everything below
+	static std::condition_variable			s_wake;
+	static std::vector<Event>				s_pending;		// queued by the measuring threads
+	static std::map<uint32_t, std::string>	s_threadNames;
+	static std::thread						s_writer;
+	static std::ofstream					s_file;
+	static Clock::time_point				s_origin;
+	static bool								s_stopping{ false };
+
+	// Small sequential ids read better in the viewer than std::thread::id
+	static uint32_t threadId()
+	{
+		static std::atomic<uint32_t> next{ 1 };
+		thread_local uint32_t id = next++;
+		return id;
+	}
+
+	static double micros(Clock::time_point time)
+	{
+		return std::chrono::duration<double, std::micro>(time - s_origin).count();
+	}
+
+	// Formats whatever has been queued every few milliseconds, until stop() is called
+	static void writerLoop()
+	{
+		std::vector<Event> events;
+		bool first = true;
+		char line[160];
+
+		while (true)
+		{
+			bool stopping;
+			{
+				std::unique_lock<std::mutex> lock(s_mutex);
+				s_wake.wait_for(lock, std::chrono::milliseconds(50), [] { return s_stopping; });
+				events.swap(s_pending);
+				stopping = s_stopping;
+			}
+
+			for (auto& event : events)
+			{
+				std::snprintf(line, sizeof(line), "%s{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+					first ? "\n" : ",\n", event.name, micros(event.begin), micros(event.end) - micros(event.begin), event.thread);
+				s_file << line;
+				first = false;
+			}
+			events.clear();
+
+			if (stopping)
+				break;
+		}
+
+		std::lock_guard<std::mutex> lock(s_mutex);
+		for (auto& [id, name] : s_threadNames)
+		{
+			s_file << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << id
+				<< ",\"args\":{\"name\":\"" << name << "\"}}";
+			first = false;
+		}
+		s_file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+		s_file.close();
+	}
+
+	bool start(const std::string& path)
+	{
+		stop();
+
+		s_file.open(path, std::ios::trunc);
+		if (!s_file)
+		{
+			LOG_ERROR("Could not open trace file %s!", path.c_str());
+			return false;
+		}
+
+		s_file << "{\"traceEvents\":[";
+		s_origin = Clock::now();
+		s_pending.clear();
+		s_stopping = false;
+		s_writer = std::thread(writerLoop);
+		recording = true;
+
+		LOG_INFO("Tracing to %s", path.c_str());
+		return true;
+	}
+
+	void stop()
+	{
+		if (!s_writer.joinable())
+			return;
+
+		recording = false;
+		{
+			std::lock_guard<std::mutex> lock(s_mutex);
+			s_stopping = true;
+		}
+		s_wake.notify_one();
+		s_writer.join();
+
+		LOG_INFO("Trace written");
+	}
+
+	void complete(const char* name, Clock::time_point begin, Clock::time_point end)
+	{
+		Event event;
+		std::strncpy(event.name, name, sizeof(event.name) - 1);
+		event.name[sizeof(event.name) - 1] = '\0';
+		event.begin = begin;
+		event.end = end;
+		event.thread = threadId();
+
+		std::lock_guard<std::mutex> lock(s_mutex);
+		if (!s_stopping)
+			s_pending.push_back(event);
+	}
+
+	void nameThread(const std::string& name)
+	{
+		std::lock_guard<std::mutex> lock(s_mutex);
+		s_threadNames[threadId()] = name;
+	}
+
+	// Finishes the file if the program ends while a trace is still running
+	static struct StopAtExit { ~StopAtExit() { stop(); } } s_stopAtExit;
+}
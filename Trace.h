@@ -0,0 +1,37 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+// Streams timed events to a Chrome trace-event JSON file, which chrome://tracing and
+// ui.perfetto.dev can open. Events are only queued by the thread that measured them,
+// a background thread formats and writes them out, so tracing barely touches the frame.
+//
+// The profiler scopes and the job system report here whenever a trace is running.
+namespace Trace
+{
+	using Clock = std::chrono::steady_clock;
+
+	inline std::atomic<bool> recording{ false };
+
+	inline bool active()
+	{
+		return recording.load(std::memory_order_relaxed);
+	}
+
+	// Starts writing to path, false if the file can't be opened. Stops any trace already running
+	bool start(const std::string& path);
+
+	// Flushes everything queued so far and closes the file
+	void stop();
+
+	// A complete ("X") event on the calling thread, long names are cut short
+	void complete(const char* name, Clock::time_point begin, Clock::time_point end);
+
+	// Name shown for the calling thread in the viewer, can be set before a trace starts
+	void nameThread(const std::string& name);
+}
+
+#endif
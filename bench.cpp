@@ -0,0 +1,421 @@
+#include "Game.h"
+#include "Random.h"
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <atomic>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// Benchmark for the ECS systems, run headless so it works on machines without a GPU.
+// Usage: Bench [frames] [entity counts...]		(defaults: 100 frames, 1000 10000 100000)
+//
+// Every result is printed as one CSV line starting with "bench," so it can be grepped
+// out of the game's own log output:
+//		bench,<system>,<entities>,<frames>,<ms per frame>,<ns per entity>
+// followed by the memory an entity takes, see Benchmark::memory:
+//		memory,<what>,<entities>,<bytes>
+
+// Bytes handed out by operator new so far. The array and aligned forms are replaced too, the
+// nothrow ones forward to these, so every allocation through new is counted
+static std::atomic<size_t> s_heapBytes{ 0 };
+
+static void* countedAlloc(std::size_t size, std::size_t alignment)
+{
+	s_heapBytes.fetch_add(size, std::memory_order_relaxed);
+	size = size ? size : 1;
+
+	void* p = nullptr;
+	if (alignment <= alignof(std::max_align_t))
+		p = std::malloc(size);
+#ifdef _MSC_VER
+	else
+		p = _aligned_malloc(size, alignment);
+#else
+	else if (posix_memalign(&p, alignment, size) != 0)
+		p = nullptr;
+#endif
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+static void countedFree(void* p, std::size_t alignment)
+{
+#ifdef _MSC_VER
+	if (alignment > alignof(std::max_align_t))
+	{
+		_aligned_free(p);
+		return;
+	}
+#endif
+	(void)alignment;
+	std::free(p);
+}
+
+void* operator new(std::size_t size) { return countedAlloc(size, 0); }
+void* operator new[](std::size_t size) { return countedAlloc(size, 0); }
+void* operator new(std::size_t size, std::align_val_t a) { return countedAlloc(size, static_cast<std::size_t>(a)); }
+void* operator new[](std::size_t size, std::align_val_t a) { return countedAlloc(size, static_cast<std::size_t>(a)); }
+
+void operator delete(void* p) noexcept { countedFree(p, 0); }
+void operator delete[](void* p) noexcept { countedFree(p, 0); }
+void operator delete(void* p, std::size_t) noexcept { countedFree(p, 0); }
+void operator delete[](void* p, std::size_t) noexcept { countedFree(p, 0); }
+void operator delete(void* p, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete(void* p, std::size_t, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+void operator delete[](void* p, std::size_t, std::align_val_t a) noexcept { countedFree(p, static_cast<std::size_t>(a)); }
+
+// A component only the bench knows about, it isn't in ComponentTuple so it is kept in a sparse
+// store. Stands in for a rare component, see Benchmark::memory
+class CBenchMarker : public Component
+{
+public:
+	uint64_t value{ 0 };
+
+	CBenchMarker() = default;
+	CBenchMarker(uint64_t v)
+		: value(v) {}
+};
+
+// Every slot holds one of each component, whether the entity uses it or not
+template <typename... Ts>
+constexpr size_t slotBytes(const std::tuple<Ts...>*) { return (sizeof(Ts) + ...); }
+
+class Benchmark
+{
+	Game				m_game;
+	size_t				m_count;
+	Random::Generator	m_rng = Random::stream(Random::Bench);
+	std::vector<float>	m_xs, m_ys, m_angles;	// batch of random placements, see fill
+	size_t				m_firstFillBytes{ 0 };	// heap taken by the first reset, see memory
+
+	// Adds an entity with the same components the matching Game::spawn* function gives it,
+	// at the given position and heading
+	void addEntity(TagId tag, const Vec2f& pos, float angle)
+	{
+		auto& ec = m_game.m_enemyConfig;
+		auto& bc = m_game.m_bulletConfig;
+
+		auto e = m_game.m_entities.addEntity(tag);
+
+		if (tag == m_game.m_tags.bullet)
+		{
+			e.add<CTransform>(pos, Vec2f(cos(angle), sin(angle)) * bc.S, 0.0f);
+			e.add<CShape>(bc.SR, bc.V, sf::Color(bc.FR, bc.FG, bc.FB), sf::Color(bc.OR, bc.OG, bc.OB), bc.OT);
+			e.add<CCollision>(bc.CR);
+			m_game.addLifespan(e, m_rng.get(1, bc.L));
+		}
+		else
+		{
+			int vertices = m_rng.get(ec.VMIN, ec.VMAX);
+			float speed = m_rng.get(ec.SMIN, ec.SMAX);
+			bool small = tag == m_game.m_tags.sEnemy;
+			float scale = small ? 0.5f : 1.0f;
+
+			e.add<CTransform>(pos, Vec2f(cos(angle), sin(angle)) * speed, 0.0f);
+			e.add<CShape>(ec.SR * scale, vertices, sf::Color(m_rng.get(0, 255), m_rng.get(0, 255), m_rng.get(0, 255)),
+				sf::Color(ec.OR, ec.OG, ec.OB), ec.OT);
+			e.add<CCollision>(ec.CR * scale);
+			e.add<CScore>(100 * vertices * (small ? 2 : 1));
+			if (small)
+				m_game.addLifespan(e, m_rng.get(1, ec.L));
+		}
+	}
+
+	// Same, anywhere in the arena
+	void addEntity(TagId tag)
+	{
+		sf::Vector2u arena = m_game.m_arenaSize;
+		Vec2f pos(m_rng.get(0.0f, static_cast<float>(arena.x)), m_rng.get(0.0f, static_cast<float>(arena.y)));
+		addEntity(tag, pos, m_rng.get(0.0f, 6.28f));
+	}
+
+	// Tops up or trims the entities with this tag so every frame is measured at the same scale
+	void fill(TagId tag, size_t target)
+	{
+		auto& entities = m_game.m_entities.getEntities(tag);
+		size_t alive = 0;
+		for (auto& e : entities)
+		{
+			if (!e.isActive())
+				continue;
+			if (alive++ >= target)
+				e.destroy();
+		}
+
+		if (alive >= target)
+			return;
+
+		// Draw all the placements in one go
+		size_t count = target - alive;
+		sf::Vector2u arena = m_game.m_arenaSize;
+		m_xs.resize(count);
+		m_ys.resize(count);
+		m_angles.resize(count);
+		m_rng.fill(m_xs.data(), count, 0.0f, static_cast<float>(arena.x));
+		m_rng.fill(m_ys.data(), count, 0.0f, static_cast<float>(arena.y));
+		m_rng.fill(m_angles.data(), count, 0.0f, 6.28f);
+
+		for (size_t i = 0; i < count; ++i)
+			addEntity(tag, Vec2f(m_xs[i], m_ys[i]), m_angles[i]);
+	}
+
+	// Restores the population to m_count entities, split evenly between the three tags
+	void reset()
+	{
+		fill(m_game.m_tags.bullet, m_count / 3);
+		fill(m_game.m_tags.enemy, m_count / 3);
+		fill(m_game.m_tags.sEnemy, m_count - 2 * (m_count / 3));
+		m_game.m_entities.update();
+		m_game.player();
+	}
+
+	// Times one system over a number of frames. Before each frame the population is restored
+	// and prepare() runs, neither of which is included in the timing.
+	template <typename P, typename F>
+	void time(const std::string& name, int frames, P prepare, F system)
+	{
+		double total = 0.0;
+		size_t entities = 0;
+
+		for (int i = 0; i < frames; ++i)
+		{
+			reset();
+			prepare();
+			entities += m_game.m_entities.getEntities().size();
+
+			auto start = std::chrono::steady_clock::now();
+			system();
+			total += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+		}
+
+		double msPerFrame = total / 1e6 / frames;
+		double nsPerEntity = total / entities;
+
+		std::cout << "bench," << name << "," << m_count << "," << frames << "," << msPerFrame << "," << nsPerEntity << "\n";
+	}
+
+	template <typename F>
+	void time(const std::string& name, int frames, F system)
+	{
+		time(name, frames, []() {}, system);
+	}
+
+public:
+	Benchmark(size_t count)
+		: m_game("config.txt", true)
+		, m_count(count)
+	{
+		// The spawner would add entities on its own schedule, keep the population synthetic
+		m_game.m_systems.spawning = false;
+
+		// Same population on every run, so results can be compared between builds
+		m_game.seed(count);
+		m_rng = Random::stream(Random::Bench);
+
+		size_t before = s_heapBytes.load();
+		reset();
+		m_firstFillBytes = s_heapBytes.load() - before;
+	}
+
+	void run(int frames)
+	{
+		// Quadratic collision gets fewer frames at large scales so the run finishes
+		int collisionFrames = std::max(1, static_cast<int>(frames * 1000 / m_count));
+
+		time("EntityManager::update", frames, [&]()
+		{
+			// Recycle 1% of the bullets so the add/remove paths are exercised too
+			auto& bullets = m_game.m_entities.getEntities(m_game.m_tags.bullet);
+			for (size_t i = 0; i < bullets.size() / 100; ++i)
+			{
+				bullets[i].destroy();
+				addEntity(m_game.m_tags.bullet);
+			}
+			m_game.m_entities.update();
+		});
+		for (auto isa : { Movement::Isa::Scalar, Movement::Isa::SSE2 })
+		{
+			if (!Movement::supported(isa))
+				continue;
+			m_game.m_movementIsa = isa;
+			time(std::string("sMovement[") + Movement::name(isa) + "]", frames, [&]() { m_game.sMovement(); });
+		}
+		m_game.m_movementIsa = Movement::integrator();
+		for (auto isa : { Movement::Isa::Scalar, Movement::Isa::SSE2, Movement::Isa::AVX2 })
+		{
+			if (!Movement::supported(isa))
+				continue;
+			std::string suffix = std::string(" ") + Movement::name(isa) + "]";
+			m_game.m_narrowphaseIsa = isa;
+			m_game.m_collisionBackend = CollisionBackend::BruteForce;
+			time("sCollision[brute" + suffix, collisionFrames, [&]() { m_game.sCollision(); });
+			m_game.m_collisionBackend = CollisionBackend::Grid;
+			time("sCollision[grid" + suffix, frames, [&]() { m_game.sCollision(); });
+			m_game.m_collisionBackend = CollisionBackend::SweepAndPrune;
+			time("sCollision[sap" + suffix, frames, [&]() { m_game.sCollision(); });
+		}
+		m_game.m_narrowphaseIsa = Movement::detect();
+		m_game.m_collisionBackend = CollisionBackend::Grid;
+		runNarrowphase(frames);
+		// sLifespan moves its own clock on, so something expires every frame
+		time("sLifespan", frames, [&]() { m_game.sLifespan(); });
+
+		// After a lot of churn the free slots are handed out in no particular order, so a list in
+		// spawn order jumps around the component pools. The archetype lists stay sorted by slot
+		auto churn = [&]()
+		{
+			for (auto& e : m_game.m_entities.getEntities())
+			{
+				if (e.tag() != m_game.m_tags.player && m_rng.below(2) == 0)
+					e.destroy();
+			}
+			m_game.m_entities.update();
+			reset();
+		};
+		time("sMovement[churned]", frames, churn, [&]() { m_game.sMovement(); });
+
+		// Again with every list run on this thread, to see what the workers buy
+		size_t workers = m_game.m_jobs.workerCount(), threshold = m_game.m_jobs.threshold();
+		m_game.m_jobs.start(workers, SIZE_MAX);
+		time("sMovement[serial]", frames, [&]() { m_game.sMovement(); });
+		time("sCollision[grid serial]", frames, [&]() { m_game.sCollision(); });
+		m_game.m_jobs.start(workers, threshold);
+	}
+
+	// The batch kernel on its own: every bullet swept against the same packed list of
+	// 256 enemies, about what a crowded broadphase query hands it
+	void runNarrowphase(int frames)
+	{
+		Narrowphase::Circles circles;
+		std::vector<uint64_t> mask;
+
+		for (auto isa : { Movement::Isa::Scalar, Movement::Isa::SSE2, Movement::Isa::AVX2 })
+		{
+			if (!Movement::supported(isa))
+				continue;
+
+			time(std::string("Narrowphase::sweep[") + Movement::name(isa) + "]", frames, [&]()
+			{
+				auto& enemies = m_game.m_entities.getEntities(m_game.m_tags.enemy);
+				circles.clear();
+				for (size_t j = 0; j < enemies.size() && circles.size() < 256; ++j)
+					circles.push(enemies[j].get<CTransform>().pos, enemies[j].get<CCollision>().radius, static_cast<uint32_t>(j));
+			}, [&]()
+			{
+				for (auto& b : m_game.m_entities.getEntities(m_game.m_tags.bullet))
+				{
+					const auto& transform = b.get<CTransform>();
+					Narrowphase::sweep(transform.prevPos, transform.pos - transform.prevPos, b.get<CCollision>().radius, circles, mask, isa);
+				}
+			});
+		}
+	}
+
+	// The size of a handle, of a shape and of a whole component slot, what a component that
+	// 1% of the entities have takes in a sparse store and would take in the pools, then the heap
+	// taken per entity: by the first population, which grows every pool and list from empty,
+	// and by replacing the population once everything has reached full size
+	void memory()
+	{
+		std::cout << "memory,sizeof(Entity),," << sizeof(Entity) << "\n";
+		std::cout << "memory,sizeof(CShape),," << sizeof(CShape) << "\n";
+		std::cout << "memory,component slot," << m_count << "," << slotBytes(static_cast<const ComponentTuple*>(nullptr)) << "\n";
+
+		reset();
+
+		// One entity in a hundred gets a sparse component, compared with giving every slot one
+		size_t i = 0;
+		for (auto& e : m_game.m_entities.getEntities())
+		{
+			if (i++ % 100 == 0)
+				e.add<CBenchMarker>(i);
+		}
+		std::cout << "memory,sparse component on 1%," << m_count << "," << m_game.m_entities.sparseBytes() << "\n";
+		std::cout << "memory,same component pooled," << m_count << "," << sizeof(CBenchMarker) * m_game.m_entities.poolStats().capacity << "\n";
+
+		std::cout << "memory,heap per entity first fill," << m_count << "," << m_firstFillBytes / m_count << "\n";
+
+		// A single replacement only shows whether a vector happened to double during it, so
+		// the slot pool gets a fixed reserve, a few replacements let the lists reach their
+		// size, and the figure is the average over many more
+		auto replace = [&]()
+		{
+			for (auto& e : m_game.m_entities.getEntities())
+			{
+				if (e.tag() != m_game.m_tags.player)
+					e.destroy();
+			}
+			m_game.m_entities.update();
+
+			// The lifespan queue only lets go of dead entities once their tick comes up, as it
+			// does in the game, so run it past the longest lifespan
+			for (int tick = 0; tick <= std::max(m_game.m_bulletConfig.L, m_game.m_enemyConfig.L); ++tick)
+				m_game.sLifespan();
+			reset();
+		};
+
+		m_game.m_entities.reserve(4 * m_count);
+		for (int warm = 0; warm < 4; ++warm)
+			replace();
+
+		const int cycles = 20;
+		size_t before = s_heapBytes.load();
+		for (int cycle = 0; cycle < cycles; ++cycle)
+			replace();
+		size_t allocated = s_heapBytes.load() - before;
+		std::cout << "memory,heap per entity replaced," << m_count << "," << static_cast<double>(allocated) / (cycles * m_count) << "\n";
+	}
+
+	// A single frame in which every entity dies and as many new ones are spawned,
+	// e.g. a wave of fragments expiring while a burst of bullets is fired
+	void runBurst(int frames)
+	{
+		auto burst = [&]()
+		{
+			for (auto& e : m_game.m_entities.getEntities())
+			{
+				if (e.tag() != m_game.m_tags.player)
+					e.destroy();
+			}
+
+			for (size_t i = 0; i < m_count; ++i)
+				addEntity(m_game.m_tags.bullet);
+		};
+
+		m_game.m_entities.setStableOrder(true);
+		time("EntityManager::update[burst stable]", frames, burst, [&]() { m_game.m_entities.update(); });
+		m_game.m_entities.setStableOrder(false);
+		time("EntityManager::update[burst unstable]", frames, burst, [&]() { m_game.m_entities.update(); });
+		m_game.m_entities.setStableOrder(true);
+	}
+};
+
+int main(int argc, char* argv[])
+{
+	int frames = argc >= 2 ? std::stoi(argv[1]) : 100;
+
+	std::vector<size_t> counts;
+	for (int i = 2; i < argc; ++i)
+		counts.push_back(std::stoul(argv[i]));
+	if (counts.empty())
+		counts = { 1000, 10000, 100000 };
+
+	std::cout << "bench,system,entities,frames,ms_per_frame,ns_per_entity\n";
+	for (size_t count : counts)
+	{
+		Benchmark bench(count);
+		bench.run(frames);
+		bench.memory();
+	}
+
+	// 10k removals and 10k additions handled by one update
+	Benchmark burst(10000);
+	burst.runBurst(frames);
+
+	return 0;
+}
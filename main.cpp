@@ -1,10 +1,45 @@
 #include "Game.h"
+#include "Trace.h"
+#include "Log.h"
+#include <string>
 
 
-int main()
+int main(int argc, char* argv[])
 {
+     // Console output is printed from a background thread from here on
+     Log::start();
+
+     // "--trace <file>" can follow any of the modes below and streams the profiler timings
+     // to a Chrome trace file, T toggles tracing in game
+     for (int i = 1; i + 1 < argc; ++i)
+     {
+          if (std::string(argv[i]) == "--trace")
+               Trace::start(argv[i + 1]);
+     }
+
+     // "--headless <frames>" runs the simulation without a window and reports fps
+     if (argc >= 3 && std::string(argv[1]) == "--headless")
+     {
+          Game g("config.txt", true);
+          g.step(std::stoi(argv[2]));
+          return 0;
+     }
+
+     // "--replay <file>" plays a recorded session back headless and reports the result
+     if (argc >= 3 && std::string(argv[1]) == "--replay")
+     {
+          Game g("config.txt", true);
+          g.replay(argv[2]);
+          return 0;
+     }
+
      Game g("config.txt");
+
+     // "--record <file>" saves the seed and the player's input for --replay
+     if (argc >= 3 && std::string(argv[1]) == "--record")
+          g.record(argv[2]);
+
      g.run();
 
 	return 0;
-}
\ No newline at end of file
+}